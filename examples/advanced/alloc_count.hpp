@@ -0,0 +1,168 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef ALLOC_COUNT_DWA2012_HPP
+# define ALLOC_COUNT_DWA2012_HPP
+
+// Replaces the global operator new and delete with versions that count
+// allocations, the bytes they request, live bytes, their peak, and
+// allocations by size class, like exercises/eh_test/eh_test.hpp does
+// for exception testing.  Include in exactly one translation unit,
+// built with the Makefile's COUNTFLAGS.
+
+# include <cstdio>
+# include <cstdlib>
+# include <new>
+
+namespace counting
+{
+  std::size_t allocations;
+  std::size_t allocated_bytes;
+  std::size_t live_bytes;
+  std::size_t deallocations;
+  std::size_t peak_bytes;           // the most live_bytes since reset_peak()
+
+  // Class 0 is up to 8 bytes, and each class after doubles the limit;
+  // the last takes everything bigger
+  std::size_t const size_classes = 28;
+  std::size_t by_size[size_classes];
+
+  inline std::size_t size_class(std::size_t size)
+  {
+      std::size_t c = 0;
+      while (c < size_classes - 1 && (std::size_t(8) << c) < size)
+          ++c;
+      return c;
+  }
+
+  inline void reset_peak()
+  {
+      peak_bytes = live_bytes;
+  }
+
+  // Each block is preceded by its size, so delete can account for it
+  union header
+  {
+      std::size_t size;
+      long double align;
+  };
+
+  // What was allocated and freed from construction until stop().
+  // Phases shouldn't overlap: each starts its own peak.
+  class phase
+  {
+   public:
+      explicit phase(char const* name)
+        : name(name), stopped(false)
+      {
+          reset_peak();
+          record(start);
+      }
+
+      void stop()
+      {
+          if (!stopped)
+              record(end);
+          stopped = true;
+      }
+
+      std::size_t allocations() const { return after().allocations - start.allocations; }
+      std::size_t deallocations() const { return after().deallocations - start.deallocations; }
+      std::size_t bytes() const { return after().allocated_bytes - start.allocated_bytes; }
+
+      // Live bytes at the end, less those at the start
+      long live_change() const { return long(after().live_bytes) - long(start.live_bytes); }
+
+      // The most bytes live at once, counting those live at the start
+      std::size_t peak() const { return after().peak_bytes; }
+
+      void print(std::FILE* out = stdout) const
+      {
+          std::fprintf(out, "%-10s %10lu allocations %10lu frees %12lu bytes  "
+                       "%+12ld live  %12lu peak\n",
+                       name, (unsigned long)allocations(), (unsigned long)deallocations(),
+                       (unsigned long)bytes(), live_change(), (unsigned long)peak());
+
+          snapshot const a = after();
+          char const* separator = "           sizes:";
+          for (std::size_t c = 0; c < size_classes; ++c)
+          {
+              std::size_t const n = a.by_size[c] - start.by_size[c];
+              if (!n)
+                  continue;
+              if (c == size_classes - 1)
+                  std::fprintf(out, "%s >%lu: %lu", separator, (unsigned long)(8) << (c - 1), (unsigned long)n);
+              else
+                  std::fprintf(out, "%s <=%lu: %lu", separator, (unsigned long)(8) << c, (unsigned long)n);
+              separator = ",";
+          }
+          if (*separator == ',')
+              std::fprintf(out, "\n");
+      }
+
+   private:
+      struct snapshot
+      {
+          std::size_t allocations, deallocations, allocated_bytes, live_bytes, peak_bytes;
+          std::size_t by_size[size_classes];
+      };
+
+      static void record(snapshot& s)
+      {
+          s.allocations = counting::allocations;
+          s.deallocations = counting::deallocations;
+          s.allocated_bytes = counting::allocated_bytes;
+          s.live_bytes = counting::live_bytes;
+          s.peak_bytes = counting::peak_bytes;
+          for (std::size_t c = 0; c < size_classes; ++c)
+              s.by_size[c] = counting::by_size[c];
+      }
+
+      // The counts at stop(), or now
+      snapshot after() const
+      {
+          if (stopped)
+              return end;
+          snapshot s;
+          record(s);
+          return s;
+      }
+
+      char const* name;
+      bool stopped;
+      snapshot start, end;
+  };
+}
+
+void* operator new(std::size_t size)
+{
+    counting::header* const h
+        = static_cast<counting::header*>(std::malloc(sizeof(counting::header) + size));
+    if (!h)
+        throw std::bad_alloc();
+    h->size = size;
+    ++counting::allocations;
+    ++counting::by_size[counting::size_class(size)];
+    counting::allocated_bytes += size;
+    counting::live_bytes += size;
+    if (counting::live_bytes > counting::peak_bytes)
+        counting::peak_bytes = counting::live_bytes;
+    return h + 1;
+}
+
+void operator delete(void* p) throw()
+{
+    if (!p)
+        return;
+    counting::header* const h = static_cast<counting::header*>(p) - 1;
+    counting::live_bytes -= h->size;
+    ++counting::deallocations;
+    std::free(h);
+}
+
+void operator delete(void* p, std::size_t) throw()
+{
+    operator delete(p);
+}
+
+#endif // ALLOC_COUNT_DWA2012_HPP
@@ -308,7 +308,7 @@ struct any_equal
 inline bool operator==(json_value const& x, json_value const& y)
 {
     return x.stored_value.type() == y.stored_value.type()
-        && json_apply( boost::bind(any_equal(), boost::cref(x), _1), y.stored_value );
+        && json_apply( boost::bind(any_equal(), boost::cref(x.stored_value), _1), y );
 }
 
 struct any_less
@@ -327,9 +327,12 @@ inline bool operator<(json_value const& x, json_value const& y)
     LOG(x.stored_value.type().name() <<": " << x << " <? " << y.stored_value.type().name()<<": " << y);
     return x.stored_value.type().before(y.stored_value.type())
         || !y.stored_value.type().before(x.stored_value.type())
-           && json_apply( boost::bind(any_less(), boost::cref(x.stored_value), _1), y.stored_value );
+           && json_apply( boost::bind(any_less(), boost::cref(x.stored_value), _1), y );
 }
 
+// ------------ test driver --------------
+
+#ifndef NO_TEST
 #include <iostream>
 
 int main(int const argc, char const*argv[])
@@ -349,6 +352,7 @@ int main(int const argc, char const*argv[])
     a.push_back(json_integer(1));
     a.push_back(json_float(42.7));
     a.push_back(json_string("b\"a\"z"));
+    assert(json_value(a) == json_value(a) && json_value(a) != json_value(json_array()));
     std::cout << "---------------------------" << std::endl;
     std::cout << a << std::endl;
     
@@ -368,3 +372,4 @@ int main(int const argc, char const*argv[])
     std::sort(a.begin(), a.end());
     std::cout << a << std::endl;
 }
+#endif
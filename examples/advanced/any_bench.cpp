@@ -0,0 +1,18 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over any.cpp's json_value, which holds a boost::any
+//
+//   ./any_bench [values]
+
+#define NO_TEST
+#include "any.cpp"
+#define REPR_ORDERED
+#define REPR_EXPONENTIAL_LESS
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("boost::any", argc, argv);
+}
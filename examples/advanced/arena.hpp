@@ -0,0 +1,319 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef ARENA_DWA2012_HPP
+# define ARENA_DWA2012_HPP
+
+// A monotonic arena, an allocator that draws from one or, by default,
+// from the heap, and a small vector that uses it
+
+# include <boost/noncopyable.hpp>
+# include <boost/move/move.hpp>
+# include <boost/cstdint.hpp>
+# include <boost/type_traits/alignment_of.hpp>
+# include <boost/type_traits/integral_constant.hpp>
+# include <algorithm>
+# include <cstddef>
+# include <new>
+
+// Allocation bumps a pointer through a chain of blocks, each twice the
+// size of the last; deallocation does nothing, and the destructor frees
+// every block at once.
+class arena : boost::noncopyable
+{
+ public:
+    explicit arena(std::size_t first_block = 16 * 1024)
+      : blocks(0), next(0), end(0), next_size(first_block), total(0)
+    {}
+
+    ~arena()
+    {
+        while (blocks)
+        {
+            block* const b = blocks;
+            blocks = b->previous;
+            ::operator delete(b);
+        }
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        char* p = align(next, alignment);
+        if (!blocks || p > end || std::size_t(end - p) < size)
+        {
+            grow(size + alignment);
+            p = align(next, alignment);
+        }
+        next = p + size;
+        return p;
+    }
+
+    // Bytes reserved from the heap so far
+    std::size_t capacity() const { return total; }
+
+ private:
+    struct block
+    {
+        block* previous;
+        long double align;      // the most strictly aligned type used
+    };
+
+    static char* align(char* p, std::size_t alignment)
+    {
+        std::size_t const a = alignment - 1;
+        return reinterpret_cast<char*>((reinterpret_cast<std::size_t>(p) + a) & ~a);
+    }
+
+    void grow(std::size_t size)
+    {
+        std::size_t const n = std::max(next_size, size);
+        block* const b = static_cast<block*>(::operator new(offsetof(block, align) + n));
+        b->previous = blocks;
+        blocks = b;
+        next = reinterpret_cast<char*>(&b->align);
+        end = next + n;
+        next_size = n * 2;
+        total += n;
+    }
+
+    block* blocks;
+    char* next;
+    char* end;
+    std::size_t next_size;
+    std::size_t total;
+};
+
+// Containers using arena_allocator can live in an arena or on the heap.
+// Moves and swaps carry the arena along; copies always go to the heap,
+// so a copy can outlive the arena its original came from.
+template <class T>
+struct arena_allocator
+{
+    typedef T value_type;
+    typedef boost::true_type propagate_on_container_move_assignment;
+    typedef boost::true_type propagate_on_container_swap;
+
+    template <class U> struct rebind { typedef arena_allocator<U> other; };
+
+    arena_allocator() : memory(0) {}
+    explicit arena_allocator(arena* memory) : memory(memory) {}
+
+    template <class U>
+    arena_allocator(arena_allocator<U> const& x) : memory(x.memory) {}
+
+    T* allocate(std::size_t n)
+    {
+        std::size_t const size = n * sizeof(T);
+        return static_cast<T*>(
+            memory ? memory->allocate(size, boost::alignment_of<T>::value) : ::operator new(size));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        if (!memory)
+            ::operator delete(p);
+    }
+
+    arena_allocator select_on_container_copy_construction() const
+    {
+        return arena_allocator();
+    }
+
+    template <class U>
+    bool operator==(arena_allocator<U> const& x) const { return memory == x.memory; }
+
+    template <class U>
+    bool operator!=(arena_allocator<U> const& x) const { return memory != x.memory; }
+
+    arena* memory;    // 0 for the heap
+};
+
+// A vector using an arena_allocator, in 24 bytes instead of
+// boost::container::vector's 32: the arena, the elements, and 32-bit
+// size and capacity.  Like arena_allocator's containers, its copies go
+// to the heap.
+template <class T>
+class arena_vector
+{
+ public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef T const* const_iterator;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef arena_allocator<T> allocator_type;
+
+    arena_vector() : memory(0), elements(0), length(0), room(0) {}
+
+    explicit arena_vector(allocator_type const& a)
+      : memory(a.memory), elements(0), length(0), room(0)
+    {}
+
+    arena_vector(arena_vector const& x)
+      : memory(0), elements(0), length(0), room(0)
+    {
+        reserve(x.size());
+        try
+        {
+            for (const_iterator i = x.begin(); i != x.end(); ++i)
+                push_back(*i);
+        }
+        catch(...)
+        {
+            clear();
+            deallocate();
+            throw;
+        }
+    }
+
+    arena_vector(BOOST_RV_REF(arena_vector) x)
+      : memory(x.memory), elements(x.elements), length(x.length), room(x.room)
+    {
+        x.elements = 0;
+        x.length = x.room = 0;
+    }
+
+    ~arena_vector()
+    {
+        clear();
+        deallocate();
+    }
+
+    arena_vector& operator=(BOOST_COPY_ASSIGN_REF(arena_vector) x)
+    {
+        arena_vector(x).swap(*this);
+        return *this;
+    }
+
+    arena_vector& operator=(BOOST_RV_REF(arena_vector) x)
+    {
+        arena_vector(boost::move(x)).swap(*this);
+        return *this;
+    }
+
+    void swap(arena_vector& x)
+    {
+        std::swap(memory, x.memory);
+        std::swap(elements, x.elements);
+        std::swap(length, x.length);
+        std::swap(room, x.room);
+    }
+
+    std::size_t size() const { return length; }
+    std::size_t capacity() const { return room; }
+    bool empty() const { return length == 0; }
+
+    iterator begin() { return elements; }
+    iterator end() { return elements + length; }
+    const_iterator begin() const { return elements; }
+    const_iterator end() const { return elements + length; }
+
+    T& operator[](std::size_t i) { return elements[i]; }
+    T const& operator[](std::size_t i) const { return elements[i]; }
+    T& back() { return elements[length - 1]; }
+    T const& back() const { return elements[length - 1]; }
+
+    allocator_type get_allocator() const { return allocator_type(memory); }
+
+    void reserve(std::size_t n)
+    {
+        if (n > room)
+            grow(n);
+    }
+
+    void push_back(T const& x)
+    {
+        if (length == room)
+        {
+            // x may be one of ours
+            T copy(x);
+            grow(next_capacity());
+            new (end()) T(boost::move(copy));
+        }
+        else
+        {
+            new (end()) T(x);
+        }
+        ++length;
+    }
+
+    void push_back(BOOST_RV_REF(T) x)
+    {
+        if (length == room)
+        {
+            T moved(boost::move(x));
+            grow(next_capacity());
+            new (end()) T(boost::move(moved));
+        }
+        else
+        {
+            new (end()) T(boost::move(x));
+        }
+        ++length;
+    }
+
+    template <class A, class B>
+    void emplace_back(BOOST_FWD_REF(A) a, BOOST_FWD_REF(B) b)
+    {
+        if (length == room)
+            grow(next_capacity());
+        new (end()) T(boost::forward<A>(a), boost::forward<B>(b));
+        ++length;
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        iterator new_end = first;
+        for (iterator i = last; i != end(); ++i, ++new_end)
+            *new_end = boost::move(*i);
+        for (iterator i = new_end; i != end(); ++i)
+            i->~T();
+        length = boost::uint32_t(new_end - begin());
+        return first;
+    }
+
+    void clear()
+    {
+        for (iterator i = begin(); i != end(); ++i)
+            i->~T();
+        length = 0;
+    }
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(arena_vector)
+
+    std::size_t next_capacity() const
+    {
+        return room < 4 ? 4 : 2 * std::size_t(room);
+    }
+
+    void grow(std::size_t n)
+    {
+        T* const p = get_allocator().allocate(n);
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            new (p + i) T(boost::move(elements[i]));
+            elements[i].~T();
+        }
+        deallocate();
+        elements = p;
+        room = boost::uint32_t(n);
+    }
+
+    void deallocate()
+    {
+        if (elements)
+            get_allocator().deallocate(elements, room);
+        elements = 0;
+        room = 0;
+    }
+
+    arena* memory;
+    T* elements;
+    boost::uint32_t length;
+    boost::uint32_t room;
+};
+
+#endif // ARENA_DWA2012_HPP
@@ -0,0 +1,81 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Parse and destroy latency of a tree on the heap (parse_json_value)
+// and in an arena (json_document): many test.json-sized documents,
+// then one large one.
+//
+//   ./arena_bench [file [size]]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+#include "alloc_count.hpp"
+
+struct timing
+{
+    timing() : parse(0), destroy(0), allocations(0) {}
+
+    double parse;
+    double destroy;
+    std::size_t allocations;
+};
+
+timing heap_tree(char const* first, char const* last, int repeat)
+{
+    timing t;
+    std::size_t const allocations = counting::allocations;
+    for (int i = 0; i < repeat; ++i)
+    {
+        double const start = now();
+        token_iterator toks = tokens(first, last);
+        json_value* const v = new json_value(parse_json_value(toks));
+        double const parsed = now();
+        delete v;
+        t.destroy += now() - parsed;
+        t.parse += parsed - start;
+    }
+    t.allocations = counting::allocations - allocations;
+    return t;
+}
+
+timing arena_tree(char const* first, char const* last, int repeat)
+{
+    timing t;
+    std::size_t const allocations = counting::allocations;
+    for (int i = 0; i < repeat; ++i)
+    {
+        double const start = now();
+        json_document* const d = new json_document(tokens(first, last));
+        double const parsed = now();
+        delete d;
+        t.destroy += now() - parsed;
+        t.parse += parsed - start;
+    }
+    t.allocations = counting::allocations - allocations;
+    return t;
+}
+
+void print(char const* what, timing const& t, int repeat)
+{
+    std::printf("%-28s parse %10.2f us  destroy %10.2f us  %8.1f allocations\n", what,
+                t.parse / repeat * 1e6, t.destroy / repeat * 1e6,
+                double(t.allocations) / repeat);
+}
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::size_t const size = parse_size(argc > 2 ? argv[2] : "16M");
+
+    int const repeat = 20000;
+    print("small documents, heap", heap_tree(input.begin(), input.end(), repeat), repeat);
+    print("small documents, arena", arena_tree(input.begin(), input.end(), repeat), repeat);
+
+    std::string const text = scale(input.begin(), input.end(), size);
+    char const* const first = text.data();
+    char const* const last = first + text.size();
+    print("large document, heap", heap_tree(first, last, 1), 1);
+    print("large document, arena", arena_tree(first, last, 1), 1);
+}
@@ -0,0 +1,78 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BENCH_DWA2012_HPP
+# define BENCH_DWA2012_HPP
+
+// Minimal timing helpers shared by the *_bench.cpp drivers
+
+# include <string>
+# include <cstdlib>
+# include <cstdio>
+# include <time.h>
+
+// Seconds on a monotonic clock
+inline double now()
+{
+    timespec t;
+    ::clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Parse a size like "64", "512k", "16M" or "1G" (bytes)
+inline std::size_t parse_size(char const* text)
+{
+    char* suffix;
+    double const n = std::strtod(text, &suffix);
+    std::size_t scale = 1;
+    switch (*suffix)
+    {
+    case 'g': case 'G': scale = 1 << 30; break;
+    case 'm': case 'M': scale = 1 << 20; break;
+    case 'k': case 'K': scale = 1 << 10; break;
+    }
+    return std::size_t(n * scale);
+}
+
+// Print one result line: what, seconds, and MB/s over nbytes
+inline void report(char const* what, double seconds, std::size_t nbytes)
+{
+    std::printf("%-28s %9.3f s %10.1f MB/s\n",
+                what, seconds, nbytes / seconds / (1024 * 1024));
+}
+
+// Run f once and return the elapsed seconds
+template <class F>
+double time_it(F f)
+{
+    double const start = now();
+    f();
+    return now() - start;
+}
+
+// "[" doc "," doc "," ... doc "]", at least size bytes long
+inline std::string scale(char const* first, char const* last, std::size_t size)
+{
+    std::string text;
+    text.reserve(size + (last - first) + 2);
+    text += '[';
+    do
+    {
+        if (text.size() > 1)
+            text += ',';
+        text.append(first, last);
+    }
+    while (text.size() < size);
+    text += ']';
+    return text;
+}
+
+// Defeats dead-code elimination of benchmark results
+template <class T>
+inline void keep(T const& x)
+{
+    static T volatile const* sink;
+    sink = &x;
+}
+
+#endif // BENCH_DWA2012_HPP
@@ -0,0 +1,530 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// A binary encoding of json_value for documents that are read far more
+// often than they are written.  binary_json_view reads an encoded
+// document in place, e.g. from a memory-mapped file_source: it indexes
+// arrays in O(1) and looks keys up by binary search, decoding nothing
+// it doesn't visit.
+//
+// Everything is in native byte order.  Offsets are 32 bits, counted
+// from the first byte of the array or object that holds them.
+//
+//   document:  the 8-byte magic, then the root value
+//   value:     a tag byte, then
+//     null, false, true    nothing
+//     int8 ... int64       the integer, in the smallest size that holds it
+//     double               8 bytes, when that represents the json_float exactly
+//     long double          the json_float itself, any padding zeroed
+//     string               32-bit length, then the bytes
+//     array                32-bit count, an offset per element, the elements
+//     object               32-bit count, a (key, value) offset pair per
+//                          member in key order, then the
+//                          keys, encoded like strings without a tag, and
+//                          the values
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_BINARY_TEST
+#endif
+
+#include "parse.cpp"
+#include <boost/iterator/indirect_iterator.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace binary_json
+{
+  char const magic[8] = { 'b', 'j', 's', 'o', 'n', '\0', '\1', '\0' };
+
+  enum tag
+  {
+      null_tag, false_tag, true_tag,
+      int8_tag, int16_tag, int32_tag, int64_tag,
+      double_tag, long_double_tag,
+      string_tag, array_tag, object_tag
+  };
+
+  typedef boost::uint32_t offset;
+
+  // The bytes of a json_float that hold its value
+  std::size_t const float_bytes
+    = std::numeric_limits<json_float>::digits == 64 ? 10 : sizeof(json_float);
+
+  template <class T>
+  inline void put(std::string& out, T x)
+  {
+      out.append(reinterpret_cast<char const*>(&x), sizeof(x));
+  }
+
+  // Nothing in the encoding is aligned
+  template <class T>
+  inline T get(char const* p)
+  {
+      T x;
+      std::memcpy(&x, p, sizeof(x));
+      return x;
+  }
+
+  // Store the distance from start to the end of out at out[at]
+  inline void patch(std::string& out, std::size_t at, std::size_t start)
+  {
+      std::size_t const distance = out.size() - start;
+      if (distance > 0xFFFFFFFFu)
+          throw std::length_error("binary_json: container exceeds 4GB");
+      offset const x = offset(distance);
+      std::memcpy(&out[at], &x, sizeof(x));
+  }
+
+  inline void put_text(std::string& out, char const* first, std::size_t size)
+  {
+      if (size > 0xFFFFFFFFu)
+          throw std::length_error("binary_json: string exceeds 4GB");
+      put(out, offset(size));
+      out.append(first, size);
+  }
+
+  struct encoder : boost::static_visitor<>
+  {
+      explicit encoder(std::string& out) : out(out) {}
+
+      void operator()(json_null) const
+      {
+          out += char(null_tag);
+      }
+
+      void operator()(bool b) const
+      {
+          out += char(b ? true_tag : false_tag);
+      }
+
+      void operator()(json_integer i) const
+      {
+          if (i == boost::int8_t(i))
+          {
+              out += char(int8_tag);
+              put(out, boost::int8_t(i));
+          }
+          else if (i == boost::int16_t(i))
+          {
+              out += char(int16_tag);
+              put(out, boost::int16_t(i));
+          }
+          else if (i == boost::int32_t(i))
+          {
+              out += char(int32_tag);
+              put(out, boost::int32_t(i));
+          }
+          else
+          {
+              out += char(int64_tag);
+              put(out, boost::int64_t(i));
+          }
+      }
+
+      void operator()(json_float f) const
+      {
+          if (json_float(double(f)) == f)
+          {
+              out += char(double_tag);
+              put(out, double(f));
+          }
+          else
+          {
+              // An x87 long double is padded to 12 or 16 bytes, which
+              // are indeterminate; they're encoded as zeros
+              out += char(long_double_tag);
+              char bytes[sizeof(json_float)] = {};
+              std::memcpy(bytes, &f, float_bytes);
+              out.append(bytes, sizeof(bytes));
+          }
+      }
+
+      void operator()(json_string const& s) const
+      {
+          out += char(string_tag);
+          put_text(out, s.data(), s.size());
+      }
+
+      void operator()(json_array const& a) const
+      {
+          std::size_t const start = out.size();
+          out += char(array_tag);
+          put(out, offset(a.size()));
+          std::size_t table = out.size();
+          out.resize(table + a.size() * sizeof(offset));
+
+          BOOST_FOREACH(json_value const& v, a)
+          {
+              patch(out, table, start);
+              table += sizeof(offset);
+              boost::apply_visitor(*this, v);
+          }
+      }
+
+      void operator()(json_object const& o) const
+      {
+          if (!o.hashed())
+          {
+              members(o.size(), o.begin(), o.end());
+              return;
+          }
+
+          // Lookups bisect, so the members go in key order, not the
+          // order a hashed object keeps
+          std::vector<json_object::value_type const*> sorted;
+          sorted.reserve(o.size());
+          BOOST_FOREACH(json_object::value_type const& m, o)
+              sorted.push_back(&m);
+          std::sort(sorted.begin(), sorted.end(), member_pointer_less());
+          members(o.size(), boost::make_indirect_iterator(sorted.begin()),
+                  boost::make_indirect_iterator(sorted.end()));
+      }
+
+      template <class Iterator>
+      void members(std::size_t n, Iterator first, Iterator last) const
+      {
+          std::size_t const start = out.size();
+          out += char(object_tag);
+          put(out, offset(n));
+          std::size_t const table = out.size();
+          out.resize(table + n * 2 * sizeof(offset));
+
+          std::size_t at = table;
+          for (Iterator m = first; m != last; ++m)
+          {
+              patch(out, at, start);
+              at += 2 * sizeof(offset);
+              put_text(out, m->first.str().data(), m->first.str().size());
+          }
+
+          at = table + sizeof(offset);
+          for (Iterator m = first; m != last; ++m)
+          {
+              patch(out, at, start);
+              at += 2 * sizeof(offset);
+              boost::apply_visitor(*this, m->second);
+          }
+      }
+
+      std::string& out;
+  };
+
+  inline string_span text_at(char const* p)
+  {
+      char const* const first = p + sizeof(offset);
+      return string_span(first, first + get<offset>(p));
+  }
+
+  // The order of json_key's operator<
+  inline bool text_less(string_span x, string_span y)
+  {
+      std::size_t const n = std::min(x.size(), y.size());
+      int const c = n ? std::memcmp(x.begin(), y.begin(), n) : 0;
+      return c ? c < 0 : x.size() < y.size();
+  }
+}
+
+// Appends the encoding of v to out
+inline void encode_binary_json(json_value const& v, std::string& out)
+{
+    out.append(binary_json::magic, sizeof(binary_json::magic));
+    boost::apply_visitor(binary_json::encoder(out), v);
+}
+
+inline std::string encode_binary_json(json_value const& v)
+{
+    std::string out;
+    encode_binary_json(v, out);
+    return out;
+}
+
+// A value in an encoded document, read in place.  The view refers to
+// the encoded bytes, which must outlive it.  Asking for the wrong kind
+// of value is a precondition violation.
+class binary_json_view
+{
+ public:
+    enum kind { null_kind, bool_kind, integer_kind, float_kind, string_kind, array_kind, object_kind };
+
+    // The root of the document in [first, last).  Throws
+    // std::invalid_argument if that is not an encoded document; the
+    // rest of the encoding is trusted.
+    binary_json_view(char const* first, char const* last)
+      : p(first + sizeof(binary_json::magic))
+    {
+        if (std::size_t(last - first) <= sizeof(binary_json::magic)
+            || std::memcmp(first, binary_json::magic, sizeof(binary_json::magic)) != 0)
+        {
+            throw std::invalid_argument("not a binary JSON document");
+        }
+    }
+
+    kind type() const
+    {
+        switch (*p)
+        {
+        case binary_json::null_tag: return null_kind;
+        case binary_json::false_tag: case binary_json::true_tag: return bool_kind;
+        case binary_json::int8_tag: case binary_json::int16_tag:
+        case binary_json::int32_tag: case binary_json::int64_tag: return integer_kind;
+        case binary_json::double_tag: case binary_json::long_double_tag: return float_kind;
+        case binary_json::string_tag: return string_kind;
+        case binary_json::array_tag: return array_kind;
+        default:
+            assert(*p == binary_json::object_tag);
+            return object_kind;
+        }
+    }
+
+    bool as_bool() const
+    {
+        assert(type() == bool_kind);
+        return *p == binary_json::true_tag;
+    }
+
+    json_integer as_integer() const
+    {
+        using namespace binary_json;
+        switch (*p)
+        {
+        case int8_tag: return get<boost::int8_t>(p + 1);
+        case int16_tag: return get<boost::int16_t>(p + 1);
+        case int32_tag: return get<boost::int32_t>(p + 1);
+        default:
+            assert(*p == int64_tag);
+            return json_integer(get<boost::int64_t>(p + 1));
+        }
+    }
+
+    json_float as_float() const
+    {
+        assert(type() == float_kind);
+        return *p == binary_json::double_tag
+            ? json_float(binary_json::get<double>(p + 1))
+            : binary_json::get<json_float>(p + 1);
+    }
+
+    string_span as_string() const
+    {
+        assert(type() == string_kind);
+        return binary_json::text_at(p + 1);
+    }
+
+    // The number of elements or members
+    std::size_t size() const
+    {
+        assert(type() == array_kind || type() == object_kind);
+        return binary_json::get<binary_json::offset>(p + 1);
+    }
+
+    binary_json_view operator[](std::size_t i) const
+    {
+        assert(type() == array_kind && i < size());
+        return at(table() + i * sizeof(binary_json::offset));
+    }
+
+    // The key and value of the ith member, in key order
+    string_span key(std::size_t i) const
+    {
+        assert(type() == object_kind && i < size());
+        return binary_json::text_at(p + entry(i));
+    }
+
+    binary_json_view value(std::size_t i) const
+    {
+        assert(type() == object_kind && i < size());
+        return at(table() + (2 * i + 1) * sizeof(binary_json::offset));
+    }
+
+    boost::optional<binary_json_view> find(string_span k) const
+    {
+        std::size_t first = 0;
+        std::size_t n = size();
+        while (n)
+        {
+            std::size_t const half = n / 2;
+            if (binary_json::text_less(key(first + half), k))
+            {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else
+            {
+                n = half;
+            }
+        }
+        if (first == size() || binary_json::text_less(k, key(first)))
+            return boost::none;
+        return value(first);
+    }
+
+    boost::optional<binary_json_view> find(char const* k) const
+    {
+        return find(string_span(k, k + std::strlen(k)));
+    }
+
+    // Build the json_value, interning keys in atoms and allocating
+    // with its allocator
+    json_value decode(json_atom_table& atoms) const
+    {
+        switch (type())
+        {
+        case null_kind:
+            return json_null();
+        case bool_kind:
+            return as_bool();
+        case integer_kind:
+            return as_integer();
+        case float_kind:
+            return as_float();
+        case string_kind:
+        {
+            string_span const s = as_string();
+            json_string str(s.begin(), s.end(), atoms.allocator());
+            return json_value(MOVE(str));
+        }
+        case array_kind:
+        {
+            json_array a(atoms.allocator());
+            a.reserve(size());
+            for (std::size_t i = 0; i < size(); ++i)
+                a.push_back((*this)[i].decode(atoms));
+            return json_value(MOVE(a));
+        }
+        default:
+        {
+            // Already in key order, without duplicates
+            json_object::sequence_type members(atoms.allocator());
+            members.reserve(size());
+            for (std::size_t i = 0; i < size(); ++i)
+            {
+                string_span const k = key(i);
+                members.emplace_back(atoms.intern(k.begin(), k.end()), value(i).decode(atoms));
+            }
+            json_object o(atoms.allocator());
+            o.adopt_sequence(boost::container::ordered_unique_range, MOVE(members));
+            return json_value(MOVE(o));
+        }
+        }
+    }
+
+ private:
+    explicit binary_json_view(char const* p) : p(p) {}
+
+    char const* table() const
+    {
+        return p + 1 + sizeof(binary_json::offset);
+    }
+
+    binary_json::offset entry(std::size_t i) const
+    {
+        return binary_json::get<binary_json::offset>(table() + 2 * i * sizeof(binary_json::offset));
+    }
+
+    binary_json_view at(char const* slot) const
+    {
+        return binary_json_view(p + binary_json::get<binary_json::offset>(slot));
+    }
+
+    char const* p;      // the tag
+};
+
+inline json_value decode_binary_json(char const* first, char const* last)
+{
+    json_atom_table atoms;
+    return binary_json_view(first, last).decode(atoms);
+}
+
+#ifdef BUILD_BINARY_TEST
+# include <iostream>
+# include <cstdlib>
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    token_iterator toks = tokens(input);
+    json_value const original = parse_json_value(toks);
+
+    std::string const encoded = encode_binary_json(original);
+    std::cout << input.size() << " bytes of text, " << encoded.size() << " encoded" << std::endl;
+    assert(decode_binary_json(encoded.data(), encoded.data() + encoded.size()) == original);
+
+    // Read in place from a memory-mapped file
+    char path[] = "/tmp/binary_testXXXXXX";
+    int const fd = ::mkstemp(path);
+    assert(fd >= 0);
+    assert(::write(fd, encoded.data(), encoded.size()) == ssize_t(encoded.size()));
+    ::close(fd);
+    {
+        file_source mapped(path);
+        ::unlink(path);
+
+        binary_json_view const root(mapped.begin(), mapped.end());
+        assert(root.type() == binary_json_view::object_kind && root.size() == 1);
+        binary_json_view const servlets = *root.find("web-app")->find("servlet");
+        assert(servlets.type() == binary_json_view::array_kind && servlets.size() == 5);
+        binary_json_view const params = *servlets[0].find("init-param");
+        assert(params.find("cachePagesTrack")->as_integer() == 200);
+        assert(params.find("useJSP")->as_bool() == false);
+        assert(!params.find("no such key") && !params.find(""));
+        string_span const name = servlets[4].find("servlet-name")->as_string();
+        assert(std::string(name.begin(), name.end()) == "cofaxTools");
+
+        // Keys come back in json_object's order
+        for (std::size_t i = 1; i < params.size(); ++i)
+            assert(binary_json::text_less(params.key(i - 1), params.key(i)));
+        for (std::size_t i = 0; i < params.size(); ++i)
+            assert(params.find(params.key(i))->type() == params.value(i).type());
+
+        json_atom_table atoms;
+        assert(root.decode(atoms) == original);
+    }
+
+    // Every kind of scalar, at the edges of each encoding
+    json_array a;
+    a.push_back(json_null());
+    a.push_back(true);
+    a.push_back(false);
+    a.push_back(json_integer(-128));
+    a.push_back(json_integer(128));
+    a.push_back(json_integer(-32769));
+    a.push_back(json_integer(1) << 40);
+    a.push_back(json_float(0.5));
+    a.push_back(json_float(1) / 3);
+    a.push_back("");
+    a.push_back(json_array());
+    a.push_back(json_object());
+    json_value const scalars = json_value(MOVE(a));
+    std::string const e = encode_binary_json(scalars);
+    assert(decode_binary_json(e.data(), e.data() + e.size()) == scalars);
+
+    binary_json_view const v(e.data(), e.data() + e.size());
+    assert(v.size() == 12 && v[0].type() == binary_json_view::null_kind);
+    assert(v[1].as_bool() && !v[2].as_bool());
+    assert(v[3].as_integer() == -128 && v[4].as_integer() == 128);
+    assert(v[5].as_integer() == -32769 && v[6].as_integer() == json_integer(1) << 40);
+    assert(v[7].as_float() == 0.5 && v[8].as_float() == json_float(1) / 3);
+    assert(v[9].as_string().empty() && v[10].size() == 0 && !v[11].find("x"));
+
+    // The same float always encodes the same way
+    std::string const third = encode_binary_json(json_value(json_float(1) / 3));
+    assert(third.size() == sizeof(binary_json::magic) + 1 + sizeof(json_float));
+    assert(third.find_first_not_of('\0', sizeof(binary_json::magic) + 1 + binary_json::float_bytes)
+           == std::string::npos);
+
+    try
+    {
+        binary_json_view bad(input.begin(), input.end());
+        assert(!"text accepted as binary");
+    }
+    catch(std::invalid_argument const&) {}
+}
+#endif
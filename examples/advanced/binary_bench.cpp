@@ -0,0 +1,87 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// What starting up from an array of copies of a file costs: parsing
+// the text into a tree, decoding the binary encoding into one, and
+// mapping the encoding to read two values in place.
+//
+//   ./binary_bench [file [size]]
+
+#define NO_TEST
+#include "binary.cpp"
+#include "bench.hpp"
+
+struct parse_text
+{
+    explicit parse_text(std::string const& text) : text(text) {}
+
+    void operator()() const
+    {
+        token_iterator toks = tokens(text);
+        keep(parse_json_value(toks));
+    }
+
+    std::string const& text;
+};
+
+struct decode_binary
+{
+    explicit decode_binary(file_source const& f) : f(f) {}
+
+    void operator()() const
+    {
+        keep(decode_binary_json(f.begin(), f.end()));
+    }
+
+    file_source const& f;
+};
+
+struct read_in_place
+{
+    explicit read_in_place(char const* path) : path(path) {}
+
+    void operator()() const
+    {
+        file_source f(path);
+        binary_json_view const root(f.begin(), f.end());
+        binary_json_view const last = root[root.size() - 1];
+        keep(root[0].find("web-app")->find("servlet")->operator[](0).find("init-param")
+             ->find("cachePagesTrack")->as_integer());
+        keep(last.find("web-app")->find("servlet")->operator[](4).find("servlet-name")->as_string());
+    }
+
+    char const* path;
+};
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::size_t const size = parse_size(argc > 2 ? argv[2] : "16M");
+    std::string const text = scale(input.begin(), input.end(), size);
+
+    std::string encoded;
+    {
+        token_iterator toks = tokens(text);
+        encoded = encode_binary_json(parse_json_value(toks));
+    }
+    std::printf("%lu bytes of text, %lu encoded\n",
+                (unsigned long)text.size(), (unsigned long)encoded.size());
+
+    char path[] = "/tmp/binary_benchXXXXXX";
+    int const fd = ::mkstemp(path);
+    if (fd < 0 || ::write(fd, encoded.data(), encoded.size()) != ssize_t(encoded.size()))
+    {
+        std::perror(path);
+        return 1;
+    }
+    ::close(fd);
+
+    {
+        file_source mapped(path);
+        report("parse text", time_it(parse_text(text)), text.size());
+        report("decode binary", time_it(decode_binary(mapped)), text.size());
+    }
+    std::printf("%-28s %9.1f us\n", "map and read two values", time_it(read_in_place(path)) * 1e6);
+    ::unlink(path);
+}
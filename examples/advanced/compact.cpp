@@ -0,0 +1,954 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// A json_value in 16 bytes: a one-byte tag at the end, and in front of
+// it an integer, a double, a pointer, or up to 14 characters of a
+// string with their count.  Arrays, objects and long strings are
+// compact_vectors, one pointer to a heap block holding their size,
+// capacity and elements, so a json_value holds a container directly,
+// with no node of its own, and an array of a million numbers takes
+// 16MB instead of variant.cpp's 48MB.  A json_float that isn't exactly
+// a double is kept on the heap.
+//
+// NaN-boxing would get to 8 bytes, but only by giving up the long
+// doubles and the full 64-bit integers that variant.cpp can hold.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_COMPACT_TEST
+#endif
+
+#include <boost/move/move.hpp>
+#include <boost/container/string.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/operators.hpp>
+
+#include "shortest_float.hpp"
+#include "json_escape.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <string>
+
+struct json_null {};
+
+typedef long double json_float;
+
+#ifndef BOOST_NO_INT64_T
+typedef boost::int64_t json_integer;
+#else
+typedef boost::int32_t json_integer;
+#endif
+
+typedef boost::container::string json_string;
+
+// A vector in a single heap block, its size and capacity ahead of its
+// elements, so that it is one pointer wide and empty ones allocate
+// nothing.  Elements are moved to a bigger block with memcpy, so T
+// must not point into itself; no json_value does.
+template <class T>
+class compact_vector
+{
+    struct header
+    {
+        std::size_t size;
+        std::size_t capacity;
+    };
+    BOOST_STATIC_ASSERT(sizeof(header) % boost::alignment_of<T>::value == 0);
+
+ public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef T const* const_iterator;
+    typedef std::size_t size_type;
+
+    compact_vector() : rep(0) {}
+
+    compact_vector(compact_vector const& rhs)
+      : rep(0)
+    {
+        assign(rhs.begin(), rhs.end());
+    }
+
+    template <class Iterator>
+    compact_vector(Iterator first, Iterator last)
+      : rep(0)
+    {
+        assign(first, last);
+    }
+
+    compact_vector(BOOST_RV_REF(compact_vector) rhs)
+      : rep(rhs.rep)
+    {
+        rhs.rep = 0;
+    }
+
+    ~compact_vector()
+    {
+        release(rep);
+    }
+
+    compact_vector& operator=(BOOST_COPY_ASSIGN_REF(compact_vector) rhs)
+    {
+        compact_vector(rhs).swap(*this);
+        return *this;
+    }
+
+    compact_vector& operator=(BOOST_RV_REF(compact_vector) rhs)
+    {
+        compact_vector(boost::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    void swap(compact_vector& rhs)
+    {
+        std::swap(rep, rhs.rep);
+    }
+
+    std::size_t size() const { return rep ? rep->size : 0; }
+    std::size_t capacity() const { return rep ? rep->capacity : 0; }
+    bool empty() const { return size() == 0; }
+
+    iterator begin() { return elements(rep); }
+    iterator end() { return begin() + size(); }
+    const_iterator begin() const { return elements(rep); }
+    const_iterator end() const { return begin() + size(); }
+
+    T& operator[](std::size_t i) { return begin()[i]; }
+    T const& operator[](std::size_t i) const { return begin()[i]; }
+    T& back() { return end()[-1]; }
+
+    void reserve(std::size_t n)
+    {
+        if (n > capacity())
+            relocate(allocate(n));
+    }
+
+    void push_back(T const& x)
+    {
+        // x may be one of ours, so build the copy before moving them
+        header* const r = spare();
+        try
+        {
+            new (elements(r) + size()) T(x);
+        }
+        catch(...)
+        {
+            if (r != rep)
+                deallocate(r);
+            throw;
+        }
+        relocate(r);
+        ++rep->size;
+    }
+
+    void push_back(BOOST_RV_REF(T) x)
+    {
+        header* const r = spare();
+        new (elements(r) + size()) T(boost::move(x));
+        relocate(r);
+        ++rep->size;
+    }
+
+    iterator insert(iterator position, BOOST_RV_REF(T) x)
+    {
+        std::size_t const i = position - begin();
+        push_back(boost::move(x));
+
+        // Slide the elements after position up by one, bitwise
+        char saved[sizeof(T)];
+        std::memcpy(saved, static_cast<void*>(&back()), sizeof(T));
+        std::memmove(static_cast<void*>(begin() + i + 1), static_cast<void*>(begin() + i),
+                     (size() - 1 - i) * sizeof(T));
+        std::memcpy(static_cast<void*>(begin() + i), saved, sizeof(T));
+        return begin() + i;
+    }
+
+    friend bool operator==(compact_vector const& x, compact_vector const& y)
+    {
+        return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+    }
+
+    friend bool operator!=(compact_vector const& x, compact_vector const& y)
+    {
+        return !(x == y);
+    }
+
+    friend bool operator<(compact_vector const& x, compact_vector const& y)
+    {
+        return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
+    }
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(compact_vector)
+
+    static T* elements(header* r)
+    {
+        return r ? reinterpret_cast<T*>(r + 1) : 0;
+    }
+
+    static header* allocate(std::size_t capacity)
+    {
+        header* const r = static_cast<header*>(
+            ::operator new(sizeof(header) + capacity * sizeof(T)));
+        r->size = 0;
+        r->capacity = capacity;
+        return r;
+    }
+
+    static void deallocate(header* r)
+    {
+        ::operator delete(r);
+    }
+
+    static void release(header* r)
+    {
+        if (!r)
+            return;
+        for (T* p = elements(r), *const e = p + r->size; p != e; ++p)
+            p->~T();
+        deallocate(r);
+    }
+
+    // A block with room for one more element: ours, or a new one
+    header* spare() const
+    {
+        std::size_t const n = size();
+        if (n < capacity())
+            return rep;
+        return allocate(n < 4 ? 4 : 2 * n);
+    }
+
+    // Moves the elements into r, if it's a new block, and adopts it
+    void relocate(header* r)
+    {
+        if (r == rep)
+            return;
+        if (rep)
+        {
+            std::memcpy(static_cast<void*>(elements(r)), static_cast<void*>(elements(rep)),
+                        rep->size * sizeof(T));
+            r->size = rep->size;
+            deallocate(rep);
+        }
+        rep = r;
+    }
+
+    template <class Iterator>
+    void assign(Iterator first, Iterator last)
+    {
+        std::size_t const n = std::distance(first, last);
+        if (n == 0)
+            return;
+        header* const r = allocate(n);
+        try
+        {
+            std::uninitialized_copy(first, last, elements(r));
+        }
+        catch(...)
+        {
+            deallocate(r);
+            throw;
+        }
+        r->size = n;
+        rep = r;
+    }
+
+    header* rep;
+};
+
+struct json_value;
+typedef compact_vector<json_value> json_array;
+class json_object;
+
+inline int compare(json_value const& x, json_value const& y);
+inline void write_json(std::string& out, json_value const& v);
+
+struct json_value
+  : boost::totally_ordered<json_value>
+{
+    // What a json_value holds, in the order that < sorts them
+    enum kind { null, string, boolean, integer, floating, array, object };
+
+    json_value() { tag() = null_tag; }
+    json_value(json_null) { tag() = null_tag; }
+
+    json_value(bool b)
+    {
+        construct<bool>(b);
+        tag() = boolean_tag;
+    }
+
+    template <class T>
+    json_value(T x, typename boost::enable_if<boost::is_arithmetic<T> >::type* = 0)
+    {
+        number(x, boost::is_integral<T>());
+    }
+
+    json_value(char const* s)
+    {
+        text(s, s + std::strlen(s));
+    }
+
+    json_value(json_string const& s)
+    {
+        text(s.data(), s.data() + s.size());
+    }
+
+    json_value(json_array const& a)
+    {
+        construct<json_array>(a);
+        tag() = array_tag;
+    }
+
+    // Adopt a container's block without copying it
+    json_value(BOOST_RV_REF(json_array) a)
+    {
+        construct<json_array>(boost::move(a));
+        tag() = array_tag;
+    }
+
+    json_value(json_object const& o);
+    json_value(BOOST_RV_REF(json_object) o);
+
+    json_value(json_value const& rhs);
+
+    json_value(BOOST_RV_REF(json_value) rhs)
+    {
+        std::memcpy(storage.bytes, rhs.storage.bytes, sizeof(storage));
+        rhs.tag() = null_tag;
+    }
+
+    ~json_value() { destroy(); }
+
+    json_value& operator=(BOOST_COPY_ASSIGN_REF(json_value) rhs)
+    {
+        json_value(rhs).swap(*this);
+        return *this;
+    }
+
+    json_value& operator=(BOOST_RV_REF(json_value) rhs)
+    {
+        json_value(boost::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    template <class T>
+    json_value& operator=(T rhs)
+    {
+        json_value(boost::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    void swap(json_value& rhs)
+    {
+        char t[sizeof(storage)];
+        std::memcpy(t, storage.bytes, sizeof(storage));
+        std::memcpy(storage.bytes, rhs.storage.bytes, sizeof(storage));
+        std::memcpy(rhs.storage.bytes, t, sizeof(storage));
+    }
+
+    friend void swap(json_value& lhs, json_value& rhs)
+    {
+        lhs.swap(rhs);
+    }
+
+    kind type() const
+    {
+        static kind const kinds[] = {
+            null, string, string, boolean, integer, floating, floating, array, object
+        };
+        return kinds[tag()];
+    }
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(json_value)
+    friend class json_object;
+    friend bool operator==(json_value const& x, json_value const& y);
+    friend int compare(json_value const& x, json_value const& y);
+    friend void write_json(std::string& out, json_value const& v);
+
+    enum
+    {
+        null_tag, short_string_tag, long_string_tag, boolean_tag, integer_tag,
+        double_tag, long_double_tag, array_tag, object_tag
+    };
+
+    // Strings up to this long are kept in the json_value, with their
+    // length in the byte before the tag
+    static std::size_t const short_string = 14;
+
+    template <class T>
+    void number(T x, boost::true_type)
+    {
+        construct<json_integer>(x);
+        tag() = integer_tag;
+    }
+
+    template <class T>
+    void number(T x, boost::false_type)
+    {
+        json_float const f = x;
+        double const d = static_cast<double>(f);
+        if (d == f || f != f)
+        {
+            construct<double>(d);
+            tag() = double_tag;
+        }
+        else
+        {
+            construct<json_float*>(new json_float(f));
+            tag() = long_double_tag;
+        }
+    }
+
+    void text(char const* first, char const* last)
+    {
+        std::size_t const n = last - first;
+        if (n <= short_string)
+        {
+            std::memcpy(storage.bytes, first, n);
+            storage.bytes[short_string] = char(n);
+            tag() = short_string_tag;
+        }
+        else
+        {
+            construct<compact_vector<char> >(compact_vector<char>(first, last));
+            tag() = long_string_tag;
+        }
+    }
+
+    char const* text_data() const
+    {
+        return tag() == short_string_tag
+            ? storage.bytes : as<compact_vector<char> >().begin();
+    }
+
+    std::size_t text_size() const
+    {
+        return tag() == short_string_tag
+            ? std::size_t(storage.bytes[short_string]) : as<compact_vector<char> >().size();
+    }
+
+    json_float floating_value() const
+    {
+        return tag() == double_tag ? as<double>() : *as<json_float*>();
+    }
+
+    void destroy();
+
+    template <class T, class A>
+    void construct(A const& a)
+    {
+        BOOST_STATIC_ASSERT(sizeof(T) <= sizeof(json_integer));
+        new (storage.bytes) T(a);
+    }
+
+    template <class T>
+    void construct(BOOST_RV_REF(T) a)
+    {
+        BOOST_STATIC_ASSERT(sizeof(T) <= sizeof(json_integer));
+        new (storage.bytes) T(boost::move(a));
+    }
+
+    template <class T>
+    T& as() { return *reinterpret_cast<T*>(storage.bytes); }
+
+    template <class T>
+    T const& as() const { return *reinterpret_cast<T const*>(storage.bytes); }
+
+    unsigned char& tag() { return reinterpret_cast<unsigned char&>(storage.bytes[15]); }
+    unsigned char tag() const { return storage.bytes[15]; }
+
+    union
+    {
+        char bytes[16];
+        json_integer align;
+    } storage;
+};
+
+BOOST_STATIC_ASSERT(sizeof(json_value) == 16);
+
+struct json_member
+{
+    json_member(json_value const& key, json_value const& value)
+      : first(key), second(value) {}
+
+    json_member(BOOST_RV_REF(json_value) key)
+      : first(boost::move(key)) {}
+
+    json_value first;
+    json_value second;
+};
+
+// Members sorted by key, like a flat_map; keys are kept like string
+// values, so short ones cost nothing more than the member
+class json_object
+  : boost::totally_ordered<json_object>
+{
+ public:
+    typedef json_member value_type;
+    typedef json_member* iterator;
+    typedef json_member const* const_iterator;
+
+    json_value& operator[](char const* key)
+    {
+        return member(key, key + std::strlen(key));
+    }
+
+    json_value& operator[](json_string const& key)
+    {
+        return member(key.data(), key.data() + key.size());
+    }
+
+    std::size_t size() const { return members.size(); }
+    bool empty() const { return members.empty(); }
+    void reserve(std::size_t n) { members.reserve(n); }
+
+    iterator begin() { return members.begin(); }
+    iterator end() { return members.end(); }
+    const_iterator begin() const { return members.begin(); }
+    const_iterator end() const { return members.end(); }
+
+    friend bool operator==(json_object const& x, json_object const& y);
+    friend bool operator<(json_object const& x, json_object const& y);
+    friend int compare(json_object const& x, json_object const& y);
+
+ private:
+    friend struct json_value;
+
+    json_value& member(char const* first, char const* last)
+    {
+        std::size_t const n = last - first;
+        iterator lo = begin(), hi = end();
+        while (lo != hi)
+        {
+            iterator const mid = lo + (hi - lo) / 2;
+            std::size_t const m = mid->first.text_size();
+            int c = std::memcmp(mid->first.text_data(), first, std::min(m, n));
+            if (c == 0)
+            {
+                if (m == n)
+                    return mid->second;
+                c = m < n ? -1 : 1;
+            }
+            if (c < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        json_value key;
+        key.text(first, last);
+        return members.insert(lo, json_member(boost::move(key)))->second;
+    }
+
+    compact_vector<json_member> members;
+};
+
+inline json_value::json_value(json_object const& o)
+{
+    construct<json_object>(o);
+    tag() = object_tag;
+}
+
+inline json_value::json_value(BOOST_RV_REF(json_object) o)
+{
+    construct<json_object>(boost::move(o));
+    tag() = object_tag;
+}
+
+inline json_value::json_value(json_value const& rhs)
+{
+    switch (rhs.tag())
+    {
+    case long_string_tag: construct<compact_vector<char> >(rhs.as<compact_vector<char> >()); break;
+    case long_double_tag: construct<json_float*>(new json_float(*rhs.as<json_float*>())); break;
+    case array_tag: construct<json_array>(rhs.as<json_array>()); break;
+    case object_tag: construct<json_object>(rhs.as<json_object>()); break;
+    default:
+        std::memcpy(storage.bytes, rhs.storage.bytes, sizeof(storage));
+        return;
+    }
+    tag() = rhs.tag();
+}
+
+inline void json_value::destroy()
+{
+    switch (tag())
+    {
+    case long_string_tag: as<compact_vector<char> >().~compact_vector<char>(); break;
+    case long_double_tag: delete as<json_float*>(); break;
+    case array_tag: as<json_array>().~json_array(); break;
+    case object_tag: as<json_object>().~json_object(); break;
+    }
+}
+
+// ------------ comparison --------------
+
+inline int compare(json_array const& a, json_array const& b)
+{
+    for (std::size_t i = 0; i < a.size() && i < b.size(); ++i)
+    {
+        if (int const c = compare(a[i], b[i]))
+            return c;
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+inline int compare(json_object const& a, json_object const& b)
+{
+    json_object::const_iterator i = a.begin(), j = b.begin();
+    for (; i != a.end() && j != b.end(); ++i, ++j)
+    {
+        if (int const c = compare(i->first, j->first))
+            return c;
+        if (int const c = compare(i->second, j->second))
+            return c;
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+// Negative, zero or positive as x sorts before, with or after y.  A
+// container is compared in one pass, so unlike a lexicographical
+// compare built on <, it takes time linear in its size at any depth.
+inline int compare(json_value const& x, json_value const& y)
+{
+    json_value::kind const k = x.type();
+    if (k != y.type())
+        return k < y.type() ? -1 : 1;
+
+    switch (k)
+    {
+    case json_value::string:
+    {
+        std::size_t const m = x.text_size(), n = y.text_size();
+        int const c = std::memcmp(x.text_data(), y.text_data(), std::min(m, n));
+        return c ? c : m < n ? -1 : m > n;
+    }
+    case json_value::boolean:
+        return int(x.as<bool>()) - int(y.as<bool>());
+    case json_value::integer:
+        return x.as<json_integer>() < y.as<json_integer>()
+            ? -1 : x.as<json_integer>() > y.as<json_integer>();
+    case json_value::floating:
+    {
+        json_float const a = x.floating_value(), b = y.floating_value();
+        return a < b ? -1 : a > b;
+    }
+    case json_value::array:
+        return compare(x.as<json_array>(), y.as<json_array>());
+    case json_value::object:
+        return compare(x.as<json_object>(), y.as<json_object>());
+    default:
+        return 0;
+    }
+}
+
+// Unlike compare(), which puts them in order, NaNs are unequal, even
+// to themselves, at any depth
+inline bool operator==(json_value const& x, json_value const& y)
+{
+    if (x.type() != y.type())
+        return false;
+
+    switch (x.type())
+    {
+    case json_value::floating:
+        return x.floating_value() == y.floating_value();
+    case json_value::array:
+    {
+        json_array const& a = x.as<json_array>();
+        json_array const& b = y.as<json_array>();
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+    }
+    case json_value::object:
+        return x.as<json_object>() == y.as<json_object>();
+    default:
+        return compare(x, y) == 0;
+    }
+}
+
+inline bool operator<(json_value const& x, json_value const& y)
+{
+    return compare(x, y) < 0;
+}
+
+inline bool operator==(json_object const& x, json_object const& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (json_object::const_iterator i = x.begin(), j = y.begin(); i != x.end(); ++i, ++j)
+    {
+        if (!(i->first == j->first) || !(i->second == j->second))
+            return false;
+    }
+    return true;
+}
+
+inline bool operator<(json_object const& x, json_object const& y)
+{
+    return compare(x, y) < 0;
+}
+
+// ------------ output --------------
+
+inline void write_json(std::string& out, char const* first, char const* last)
+{
+    json_escape::append_quoted(out, first, last);
+}
+
+inline void write_json(std::string& out, json_array const& a)
+{
+    out += '[';
+    for (json_array::const_iterator i = a.begin(); i != a.end(); ++i)
+    {
+        if (i != a.begin())
+            out += ',';
+        write_json(out, *i);
+    }
+    out += ']';
+}
+
+inline void write_json(std::string& out, json_object const& o)
+{
+    out += '{';
+    for (json_object::const_iterator i = o.begin(); i != o.end(); ++i)
+    {
+        if (i != o.begin())
+            out += ',';
+        write_json(out, i->first);
+        out += ':';
+        write_json(out, i->second);
+    }
+    out += '}';
+}
+
+inline void write_json(std::string& out, json_value const& v)
+{
+    switch (v.tag())
+    {
+    case json_value::null_tag:
+        out.append("null", 4);
+        break;
+    case json_value::short_string_tag:
+    case json_value::long_string_tag:
+        write_json(out, v.text_data(), v.text_data() + v.text_size());
+        break;
+    case json_value::boolean_tag:
+        if (v.as<bool>())
+            out.append("true", 4);
+        else
+            out.append("false", 5);
+        break;
+    case json_value::integer_tag:
+    {
+        json_integer const i = v.as<json_integer>();
+        char digits[24];
+        char* p = digits + sizeof(digits);
+        boost::uint64_t n = i < 0 ? 0 - boost::uint64_t(i) : boost::uint64_t(i);
+        do
+        {
+            *--p = char('0' + n % 10);
+            n /= 10;
+        }
+        while (n);
+        if (i < 0)
+            *--p = '-';
+        out.append(p, digits + sizeof(digits) - p);
+        break;
+    }
+    case json_value::double_tag:
+    case json_value::long_double_tag:
+    {
+        // JSON has no infinities or NaNs
+        json_float const x = v.floating_value();
+        if (!(x - x == 0))
+        {
+            out.append("null", 4);
+            break;
+        }
+        char text[shortest_float::max_length];
+        out.append(text, shortest_float::format(x, text) - text);
+        break;
+    }
+    case json_value::array_tag:
+        write_json(out, v.as<json_array>());
+        break;
+    case json_value::object_tag:
+        write_json(out, v.as<json_object>());
+        break;
+    }
+}
+
+template <class T>
+inline std::ostream& print_json(std::ostream& os, T const& x)
+{
+    std::string out;
+    write_json(out, x);
+    return os.write(out.data(), out.size());
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_value const& v)
+{
+    return print_json(os, v);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_array const& a)
+{
+    return print_json(os, a);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_object const& o)
+{
+    return print_json(os, o);
+}
+
+// ------------ test driver --------------
+
+#ifdef BUILD_COMPACT_TEST
+# include "alloc_count.hpp"
+# include <cassert>
+# include <iostream>
+# include <sstream>
+
+template <class T>
+std::string printed(T const& x)
+{
+    std::ostringstream s;
+    s << x;
+    return s.str();
+}
+
+int main()
+{
+    json_value v = json_string("foo bar");
+    std::cout << v << std::endl << std::flush;
+    json_array a;
+    assert(a == a);
+    a.push_back(false);
+    assert(a != a[0]);
+    a.push_back(1);
+    a.push_back(42.7);
+    a.push_back("b\"a\"z");
+    std::cout << "---------------------------" << std::endl;
+    std::cout << a << std::endl;
+
+    json_object o;
+    o["foo"] = 1;
+    o["bar"] = "baz";
+    o["xxx"] = 3.14;
+    o["lick"] = a;
+    o["pork"] = true;
+    std::cout << o << std::endl;
+    assert(printed(o) == "{\"bar\":\"baz\",\"foo\":1,\"lick\":" + printed(a)
+                         + ",\"pork\":true,\"xxx\":" + printed(json_value(3.14)) + "}");
+    std::cout << "---------------------------" << std::endl;
+    a.push_back(9.1);
+    a.push_back(8.1);
+    a.push_back(7.1);
+    a.push_back(5);
+    std::sort(a.begin(), a.end());
+    std::cout << a << std::endl;
+    assert(printed(a) == "[\"b\\\"a\\\"z\",false,1,5," + printed(json_value(7.1)) + ","
+                         + printed(json_value(8.1)) + "," + printed(json_value(9.1)) + ","
+                         + printed(json_value(42.7)) + "]");
+
+    // Scalars and short strings live in the json_value itself
+    std::size_t allocations = counting::allocations;
+    json_value const scalars[] = {
+        json_value(), json_value(true), json_value(-9223372036854775807LL - 1),
+        json_value(0.5), json_value(1e300), json_value("fourteen chars")
+    };
+    json_value scalar_copies[] = {
+        scalars[0], scalars[1], scalars[2], scalars[3], scalars[4], scalars[5]
+    };
+    json_value moved(boost::move(scalar_copies[5]));
+    assert(counting::allocations == allocations);
+    assert(printed(scalars[2]) == "-9223372036854775808" && printed(scalars[5]) == "\"fourteen chars\"");
+    assert(moved == scalars[5] && scalar_copies[5].type() == json_value::null);
+    for (int i = 0; i < 5; ++i)
+        assert(scalar_copies[i] == scalars[i] && scalars[i].type() != json_value::string);
+
+    // The rest take one block each
+    allocations = counting::allocations;
+    json_value const long_string("fourteen chars!");
+    json_value const long_double(json_float(1) / 3);
+    assert(counting::allocations == allocations + 2);
+    assert(long_double != json_value(1.0 / 3) && json_value(1.0 / 3) < long_double);
+    assert(long_string.type() == json_value::string && json_value("fourteen chars") < long_string);
+    json_value const copied_long_double(long_double);
+    assert(copied_long_double == long_double && counting::allocations == allocations + 3);
+
+    // A million numbers in 16MB, copied in one allocation
+    json_array numbers;
+    numbers.reserve(1000000);
+    allocations = counting::allocations;
+    std::size_t const bytes = counting::allocated_bytes;
+    for (int i = 0; i < 1000000; ++i)
+        numbers.push_back(i * 0.25);
+    assert(counting::allocations == allocations);
+    json_value const n1 = numbers;
+    assert(counting::allocations == allocations + 1);
+    assert(counting::allocated_bytes - bytes <= 16 * 1000000 + 16);
+    json_value n2 = boost::move(numbers);
+    assert(numbers.empty() && counting::allocations == allocations + 1);
+    assert(n1 == n2);
+
+    // Moved by memcpy as arrays grow, and compared in one pass however
+    // deep they go
+    json_value deep = 1, deeper = 1;
+    for (int d = 0; d < 200; ++d)
+    {
+        json_array wrap;
+        wrap.push_back(boost::move(deep));
+        deep = boost::move(wrap);
+        json_object wrap2;
+        wrap2["child"] = deeper;
+        deeper = wrap2;
+    }
+    assert(deep == json_value(deep) && deeper == json_value(deeper));
+    json_value deepest = deep;
+    assert(!(deepest < deep) && deep < deeper);
+
+    // Keys are kept sorted and unique, and long ones work too
+    json_object p;
+    p["a key longer than fourteen characters"] = 1;
+    p["z"] = 2;
+    p["b"] = 3;
+    p["a key longer than fourteen characters"] = 4;
+    p[json_string("a")] = json_null();
+    assert(p.size() == 4);
+    assert(printed(p) == "{\"a\":null,\"a key longer than fourteen characters\":4,\"b\":3,\"z\":2}");
+    json_object q(p);
+    assert(q == p);
+    q["b"] = 5;
+    assert(q != p && p < q);
+
+    // Escapes, and the floats JSON can't represent
+    assert(printed(json_value("tab\there \"q\" \\ \x01/\xc3\xa9\x1f"))
+           == "\"tab\\there \\\"q\\\" \\\\ \\u0001/\xc3\xa9\\u001f\"");
+    json_float const inf = std::numeric_limits<json_float>::infinity();
+    assert(printed(json_value(inf - inf)) == "null" && printed(json_value(inf)) == "null");
+    assert(json_value(inf - inf) != json_value(inf - inf));
+    json_array nans, zeros, minus_zeros;
+    nans.push_back(inf - inf);
+    zeros.push_back(0.0);
+    minus_zeros.push_back(-0.0);
+    json_object nan_member;
+    nan_member["x"] = inf - inf;
+    assert(json_value(nans) != json_value(nans) && !(nan_member == nan_member));
+    assert(json_value(zeros) == json_value(minus_zeros));
+    assert(json_value(0) != json_value(0.0) && json_value(false) != json_value(0));
+}
+#endif
@@ -0,0 +1,17 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over compact.cpp's 16-byte tagged json_value
+//
+//   ./compact_bench [values]
+
+#define NO_TEST
+#define REPR_ORDERED
+#include "compact.cpp"
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("16-byte tagged", argc, argv);
+}
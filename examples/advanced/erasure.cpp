@@ -287,6 +287,9 @@ inline std::ostream& operator<<(std::ostream& s, json_object const& o)
     return s;
 }
 
+// ------------ test driver --------------
+
+#ifndef NO_TEST
 #include <iostream>
 
 int main()
@@ -311,3 +314,4 @@ int main()
 
     v = json_value(1);
 }
+#endif
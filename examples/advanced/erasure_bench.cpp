@@ -0,0 +1,17 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over erasure.cpp's json_value, which owns a json_base
+// on the heap and copies it with a virtual clone()
+//
+//   ./erasure_bench [values]
+
+#define NO_TEST
+#include "erasure.cpp"
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("virtual erasure", argc, argv);
+}
@@ -0,0 +1,153 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Serializes arrays of floats three ways: with the ostream default of
+// six significant digits, which doesn't round-trip; with printf and
+// enough digits to round-trip; and with json_writer, which writes the
+// shortest digits that round-trip.
+//
+//   ./float_bench [count]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+#include <sstream>
+
+// Writes json_floats, ignoring everything else
+struct print_to_stream : boost::static_visitor<>
+{
+    explicit print_to_stream(std::ostream& s) : s(s) {}
+    template <class T> void operator()(T const&) const {}
+    void operator()(json_float x) const { s << x; }
+    std::ostream& s;
+};
+
+struct print_with_printf : boost::static_visitor<>
+{
+    explicit print_with_printf(std::string& out) : out(out) {}
+    template <class T> void operator()(T const&) const {}
+    void operator()(json_float x) const
+    {
+        char text[64];
+        int n = std::snprintf(text, sizeof(text), "%.*Lg",
+                              std::numeric_limits<json_float>::max_digits10, x);
+        // Still a float when read back
+        if (std::strpbrk(text, ".e") == 0)
+        {
+            text[n++] = '.';
+            text[n++] = '0';
+        }
+        out.append(text, n);
+    }
+    std::string& out;
+};
+
+struct with_ostream
+{
+    with_ostream(json_array const& a, std::string& out) : a(a), out(out) {}
+
+    void operator()() const
+    {
+        std::ostringstream s;
+        char const* separator = "[";
+        BOOST_FOREACH(json_value const& v, a)
+        {
+            s << separator;
+            boost::apply_visitor(print_to_stream(s), v);
+            separator = ",";
+        }
+        s << "]";
+        out = s.str();
+    }
+
+    json_array const& a;
+    std::string& out;
+};
+
+struct with_printf
+{
+    with_printf(json_array const& a, std::string& out) : a(a), out(out) {}
+
+    void operator()() const
+    {
+        out = "[";
+        BOOST_FOREACH(json_value const& v, a)
+        {
+            if (out.size() > 1)
+                out += ',';
+            boost::apply_visitor(print_with_printf(out), v);
+        }
+        out += ']';
+    }
+
+    json_array const& a;
+    std::string& out;
+};
+
+struct with_writer
+{
+    with_writer(json_array const& a, std::string& out) : a(a), out(out) {}
+
+    void operator()() const
+    {
+        json_writer w;
+        w(a);
+        out.assign(w.data(), w.size());
+    }
+
+    json_array const& a;
+    std::string& out;
+};
+
+template <class Print>
+void run(char const* what, json_array const& a)
+{
+    std::string out;
+    double const t = time_it(Print(a, out));
+    token_iterator toks = tokens(out);
+    bool const same = parse_json_value(toks) == json_value(a);
+    std::printf("  %-20s %8.1f ns/number %8.1f bytes/number  %s\n", what,
+                t / a.size() * 1e9, double(out.size()) / a.size(),
+                same ? "round-trips" : "loses precision");
+}
+
+void compare(char const* what, json_array const& a)
+{
+    std::printf("%s\n", what);
+    run<with_ostream>("ostream", a);
+    run<with_printf>("printf %.21Lg", a);
+    run<with_writer>("json_writer", a);
+}
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const count = parse_size(argc > 1 ? argv[1] : "200k");
+
+    json_array prices, measurements, doubles;
+    boost::uint64_t seed = 1;
+    char text[64];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        boost::uint64_t const r = seed >> 11;
+        json_integer ignored;
+        json_float x;
+
+        // What JSON usually holds: a few digits, as text
+        std::sprintf(text, "%lu.%02lu", (unsigned long)(r % 100000), (unsigned long)(r / 100000 % 100));
+        decode_json_number(text, text + std::strlen(text), ignored, x);
+        prices.push_back(x);
+
+        std::sprintf(text, "%.9fe%d", double(r % 1000000000) / 1e9, int(r % 41) - 20);
+        decode_json_number(text, text + std::strlen(text), ignored, x);
+        measurements.push_back(x);
+
+        // Results of double arithmetic, which need all their digits
+        doubles.push_back(json_float(std::ldexp(double(r), int(r % 64) - 84)));
+    }
+
+    compare("prices, 1-7 digits", prices);
+    compare("measurements, 9 digits", measurements);
+    compare("doubles", doubles);
+}
@@ -0,0 +1,212 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// Where a document's memory goes.  json_footprint walks a tree and
+// adds up, for each kind of node, how many there are, the bytes of the
+// json_values that hold them, and the bytes each one has allocated,
+// whether on the heap or in an arena.  The json_values, and the keys,
+// are inside their containers' allocations, so a tree takes its total
+// allocated bytes plus the json_value holding the root.  The test driver runs a document
+// through tokenizing, parsing, copying, printing and destroying, with
+// alloc_count.hpp counting each phase, then breaks the tree down.
+//
+//   ./footprint [file]
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_FOOTPRINT_TEST
+#endif
+
+#include "parse.cpp"
+#include <boost/unordered_set.hpp>
+#include <cstdio>
+
+class json_footprint
+  : public boost::static_visitor<>
+{
+ public:
+    enum kind { null, boolean, integer, floating, string, array, object, key, kinds };
+
+    json_footprint()
+    {
+        for (int k = 0; k < kinds; ++k)
+            counts[k] = inline_bytes[k] = allocated_bytes[k] = 0;
+    }
+
+    // Add v, which is held in a json_value of its own, and everything
+    // in it
+    void add(json_value const& v)
+    {
+        boost::apply_visitor(*this, v);
+    }
+
+    // Of a kind; for keys, the count is of distinct key texts, and
+    // the inline bytes are those of the json_keys in objects
+    std::size_t count(kind k) const { return counts[k]; }
+    std::size_t inline_size(kind k) const { return inline_bytes[k]; }
+    std::size_t allocated(kind k) const { return allocated_bytes[k]; }
+
+    std::size_t total_allocated() const
+    {
+        std::size_t total = 0;
+        for (int k = 0; k < kinds; ++k)
+            total += allocated_bytes[k];
+        return total;
+    }
+
+    void print(std::FILE* out = stdout) const
+    {
+        static char const* const names[] = {
+            "null", "bool", "integer", "float", "string", "array", "object", "key"
+        };
+        std::fprintf(out, "%-10s %10s %14s %14s\n", "kind", "count", "inline bytes", "allocated");
+        for (int k = 0; k < kinds; ++k)
+        {
+            if (counts[k])
+                std::fprintf(out, "%-10s %10lu %14lu %14lu\n", names[k], (unsigned long)counts[k],
+                             (unsigned long)inline_bytes[k], (unsigned long)allocated_bytes[k]);
+        }
+        std::fprintf(out, "%-10s %10s %14s %14lu\n", "total", "", "",
+                     (unsigned long)total_allocated());
+    }
+
+    void operator()(json_null) { held(null); }
+    void operator()(bool) { held(boolean); }
+    void operator()(json_integer) { held(integer); }
+    void operator()(json_float) { held(floating); }
+
+    void operator()(json_string const& s)
+    {
+        held(string);
+        allocated_bytes[string] += text_bytes(s);
+    }
+
+    void operator()(json_array const& a)
+    {
+        held(array);
+        allocated_bytes[array] += a.capacity() * sizeof(json_value);
+        BOOST_FOREACH(json_value const& v, a)
+            add(v);
+    }
+
+    void operator()(json_object const& o)
+    {
+        held(object);
+        allocated_bytes[object] += o.capacity() * sizeof(json_object::value_type)
+            + o.index_bytes();
+        inline_bytes[key] += o.size() * sizeof(json_key);
+        BOOST_FOREACH(json_object::value_type const& m, o)
+        {
+            // Keys with the same atom share its text
+            json_string const& text = m.first.str();
+            if (!text.empty() && atoms.insert(&text).second)
+            {
+                ++counts[key];
+                allocated_bytes[key] += sizeof(json_atom) + text_bytes(text);
+            }
+            add(m.second);
+        }
+    }
+
+ private:
+    void held(kind k)
+    {
+        ++counts[k];
+        inline_bytes[k] += sizeof(json_value);
+    }
+
+    // Past the short string kept inside the json_string itself
+    static std::size_t text_bytes(json_string const& s)
+    {
+        static std::size_t const short_capacity = json_string().capacity();
+        return s.capacity() > short_capacity ? s.capacity() + 1 : 0;
+    }
+
+    std::size_t counts[kinds];
+    std::size_t inline_bytes[kinds];
+    std::size_t allocated_bytes[kinds];
+    boost::unordered_set<void const*> atoms;
+};
+
+#ifdef BUILD_FOOTPRINT_TEST
+# include "alloc_count.hpp"
+# include <iostream>
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::printf("%lu bytes of JSON, sizeof(json_value) = %lu\n",
+                (unsigned long)input.size(), (unsigned long)sizeof(json_value));
+
+    counting::phase tokenizing("tokenize");
+    std::size_t n = 0;
+    for (token_iterator t = tokens(input); t != token_iterator(); ++t)
+        ++n;
+    tokenizing.stop();
+    tokenizing.print();
+    assert(tokenizing.allocations() == 0);
+
+    counting::phase parsing("parse");
+    json_value* tree;
+    {
+        token_iterator toks = tokens(input);
+        tree = new json_value(parse_json_value(toks));
+    }
+    parsing.stop();
+    parsing.print();
+
+    counting::phase copying("copy");
+    json_value* const copy = new json_value(*tree);
+    copying.stop();
+    copying.print();
+
+    counting::phase printing("print");
+    {
+        json_writer w;
+        w.write(*tree);
+        assert(w.size() > 0);
+    }
+    printing.stop();
+    printing.print();
+    assert(printing.live_change() == 0);
+
+    json_footprint f, c;
+    f.add(*tree);
+    c.add(*copy);
+
+    counting::phase destroying("destroy");
+    delete copy;
+    delete tree;
+    destroying.stop();
+    destroying.print();
+    assert(destroying.allocations() == 0);
+
+    std::printf("\n%lu tokens\n", (unsigned long)n);
+    f.print();
+
+    // Everything the parse left allocated is in the tree.  The copy
+    // shares its original's keys, and its containers have no room to
+    // spare.
+    assert(parsing.live_change() == long(f.total_allocated() + sizeof(json_value)));
+    assert(copying.live_change()
+           == long(c.total_allocated() - c.allocated(json_footprint::key) + sizeof(json_value)));
+    assert(c.total_allocated() <= f.total_allocated());
+    assert(destroying.live_change() == -parsing.live_change() - copying.live_change());
+
+    // In an arena, the footprint is the same, but most of it is in a
+    // few big blocks
+    counting::phase in_arena("arena");
+    {
+        json_document d(tokens(input));
+        in_arena.stop();
+        json_footprint a;
+        a.add(d.root());
+        assert(a.total_allocated() == f.total_allocated());
+    }
+    in_arena.print();
+    assert(in_arena.allocations() < parsing.allocations());
+}
+#endif
@@ -0,0 +1,557 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// Synthetic JSON for load testing.  The same seed and options always
+// produce the same bytes, so a corpus can be regenerated instead of
+// stored.  Output is written one record at a time through a
+// json_writer, so writing 10G takes no more memory than writing 1M.
+//
+//   ./generate [options] size [> corpus.json]
+//
+//   --seed=N             pseudo-random seed (1)
+//   --ndjson             one record per line, instead of one array
+//   --depth=N            nesting depth of every record (4)
+//   --width=N            average members per object or elements per
+//                        array (6)
+//   --keys=N             distinct object keys in the corpus (100)
+//   --string-length=N    average string length; lengths are
+//                        exponentially distributed (12)
+//   --escapes=P          chance that a string character is escaped (0.01)
+//   --numbers=I,F,E      relative frequency of integers, decimals and
+//                        numbers with exponents (6,3,1)
+//   --output=FILE        write to FILE instead of standard output
+//
+// The size, like "1M", "100M" or "10G", is a lower bound: the last
+// record is always complete.  Without arguments, runs the tests.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_GENERATE_TEST
+#endif
+
+#include "parse.cpp"
+#include "validate.cpp"
+#include "bench.hpp"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct json_corpus_options
+{
+    json_corpus_options()
+      : seed(1), ndjson(false), depth(4), width(6), keys(100),
+        string_length(12), escapes(0.01), integers(6), decimals(3), exponents(1)
+    {}
+
+    boost::uint64_t seed;
+    bool ndjson;
+    unsigned depth;
+    unsigned width;
+    unsigned keys;
+    double string_length;
+    double escapes;
+    unsigned integers, decimals, exponents;
+};
+
+// Every record is an object.  One path from it, chosen at random, goes
+// down exactly options.depth levels; the other members and elements
+// are mostly scalars, so records stay small however deep they are.
+class json_generator
+{
+ public:
+    // Throws std::invalid_argument for options that can't be satisfied
+    explicit json_generator(json_corpus_options const& o)
+      : options(o), state(o.seed)
+    {
+        if (o.depth < 1 || o.width < 1 || o.keys < 1)
+            throw std::invalid_argument("depth, width and keys must be at least 1");
+        if (!(o.escapes >= 0 && o.escapes < 1))
+            throw std::invalid_argument("escapes must be at least 0 and less than 1");
+        if (!(o.string_length >= 0))
+            throw std::invalid_argument("string length must not be negative");
+        if (o.integers + o.decimals + o.exponents == 0)
+            throw std::invalid_argument("some kind of number must have a nonzero weight");
+
+        next();
+        for (unsigned i = 0; i < o.keys; ++i)
+            keys.push_back(key_name(i, o.keys));
+
+        // Plain string text is copied out of here
+        static char const plain[] =
+            "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+            "  ,.;:-_+=()!?'#$%&*<>@[]{}|~^`";
+        for (std::size_t i = 0; i < pool_size; ++i)
+            pool[i] = plain[next() % (sizeof(plain) - 1)];
+    }
+
+    // Write records to out until at least size bytes have been
+    // written, and return the number written
+    std::size_t generate(json_writer& out, std::size_t size)
+    {
+        std::size_t written = 0;
+        if (!options.ndjson)
+            written += put(out, "[", 1);
+
+        do
+        {
+            record.clear();
+            if (written > 1 && !options.ndjson)
+                record += ',';
+            object(1, true);
+            if (options.ndjson)
+                record += '\n';
+            written += put(out, record.data(), record.size());
+        }
+        while (written + !options.ndjson < size);
+
+        if (!options.ndjson)
+            written += put(out, "]", 1);
+        return written;
+    }
+
+ private:
+    static std::size_t put(json_writer& out, char const* text, std::size_t n)
+    {
+        out.append(text, n);
+        return n;
+    }
+
+    // 53 random bits
+    boost::uint64_t next()
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 11;
+    }
+
+    // In [0, 1)
+    double uniform()
+    {
+        return next() * (1.0 / (boost::uint64_t(1) << 53));
+    }
+
+    // Exponentially distributed, with the given mean
+    std::size_t exponential(double mean)
+    {
+        return std::size_t(-mean * std::log(1 - uniform()));
+    }
+
+    // Pronounceable, and all the same length, so they're distinct
+    static std::string key_name(unsigned i, unsigned count)
+    {
+        static char const consonants[] = "bdfgklmnprstvz";
+        static char const vowels[] = "aeiou";
+        unsigned const base = (sizeof(consonants) - 1) * (sizeof(vowels) - 1);
+        std::string name;
+        for (unsigned n = count - 1; n || name.empty(); n /= base, i /= base)
+        {
+            name += consonants[i % base / (sizeof(vowels) - 1)];
+            name += vowels[i % base % (sizeof(vowels) - 1)];
+        }
+        return name;
+    }
+
+    std::size_t children(bool on_path)
+    {
+        std::size_t const n = next() % (2 * options.width + 1);
+        return on_path && n == 0 ? 1 : n;
+    }
+
+    // A container at the given depth.  If it's on the path, one of its
+    // children continues the path.
+    void object(unsigned depth, bool on_path)
+    {
+        std::size_t const n = std::min<std::size_t>(children(on_path), keys.size());
+        std::size_t const path = n ? next() % n : 0;
+        std::size_t const first = next() % keys.size();
+        record += '{';
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (i)
+                record += ',';
+            std::string const& k = keys[(first + i) % keys.size()];
+            record += '"';
+            record += k;
+            record += "\":";
+            value(depth, on_path && i == path);
+        }
+        record += '}';
+    }
+
+    void array(unsigned depth, bool on_path)
+    {
+        std::size_t const n = children(on_path);
+        std::size_t const path = n ? next() % n : 0;
+        record += '[';
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (i)
+                record += ',';
+            value(depth, on_path && i == path);
+        }
+        record += ']';
+    }
+
+    // A member or element of a container at the given depth
+    void value(unsigned depth, bool on_path)
+    {
+        bool const nested = depth < options.depth
+            && (on_path || uniform() < 0.5 / options.width);
+        if (nested)
+        {
+            if (next() % 2)
+                object(depth + 1, on_path);
+            else
+                array(depth + 1, on_path);
+            return;
+        }
+
+        unsigned const kind = next() % 20;
+        if (kind < 8)
+            string();
+        else if (kind < 17)
+            number();
+        else if (kind == 17)
+            record += "true";
+        else if (kind == 18)
+            record += "false";
+        else
+            record += "null";
+    }
+
+    void digits(std::size_t n, bool leading_zero_ok)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            record += char('0' + (i || leading_zero_ok ? next() % 10 : 1 + next() % 9));
+    }
+
+    void number()
+    {
+        unsigned const total = options.integers + options.decimals + options.exponents;
+        unsigned const kind = next() % total;
+        if (next() % 5 == 0)
+            record += '-';
+
+        if (kind < options.integers)
+        {
+            // Mostly small
+            std::size_t const n = 1 + std::min<std::size_t>(exponential(2), 17);
+            if (n == 1)
+                record += char('0' + next() % 10);
+            else
+                digits(n, false);
+        }
+        else if (kind < options.integers + options.decimals)
+        {
+            digits(1 + next() % 6, false);
+            record += '.';
+            digits(1 + next() % 9, true);
+        }
+        else
+        {
+            digits(1, false);
+            record += '.';
+            digits(1 + next() % 16, true);
+            record += "eE"[next() % 2];
+            switch (next() % 3)
+            {
+            case 0: record += '-'; break;
+            case 1: record += '+'; break;
+            }
+            digits(1 + next() % 3, true);
+        }
+    }
+
+    void string()
+    {
+        std::size_t remaining = exponential(options.string_length);
+        record += '"';
+        while (remaining)
+        {
+            // Plain text up to the next escape
+            double const gap = options.escapes > 0
+                ? std::log(1 - uniform()) / std::log(1 - options.escapes)
+                : remaining;
+            std::size_t run = gap < remaining ? std::size_t(gap) : remaining;
+            remaining -= run;
+            while (run)
+            {
+                std::size_t const start = next() % pool_size;
+                std::size_t const n = std::min(run, pool_size - start);
+                record.append(pool + start, n);
+                run -= n;
+            }
+
+            if (remaining)
+            {
+                escape();
+                --remaining;
+            }
+        }
+        record += '"';
+    }
+
+    void escape()
+    {
+        static char const* const simple[] = {
+            "\\\"", "\\\\", "\\/", "\\b", "\\f", "\\n", "\\r", "\\t"
+        };
+        static char const hex[] = "0123456789abcdef";
+
+        unsigned const kind = next() % 10;
+        if (kind < 8)
+        {
+            record += simple[kind];
+            return;
+        }
+
+        // A code point below 0x80, in the BMP outside the surrogates,
+        // or beyond it as a surrogate pair
+        unsigned long c = kind == 8 ? next() % 0x80 : next() % (0x10000 - 0x800 + 0x100000);
+        if (kind == 9 && c >= 0xD800)
+            c += 0x800;
+        if (c < 0x10000)
+        {
+            char const u[] = { '\\', 'u', hex[c >> 12], hex[c >> 8 & 15], hex[c >> 4 & 15], hex[c & 15] };
+            record.append(u, sizeof(u));
+        }
+        else
+        {
+            unsigned long const v = c - 0x10000;
+            unsigned long const high = 0xD800 + (v >> 10), low = 0xDC00 + (v & 0x3FF);
+            char const u[] = {
+                '\\', 'u', hex[high >> 12], hex[high >> 8 & 15], hex[high >> 4 & 15], hex[high & 15],
+                '\\', 'u', hex[low >> 12], hex[low >> 8 & 15], hex[low >> 4 & 15], hex[low & 15]
+            };
+            record.append(u, sizeof(u));
+        }
+    }
+
+    static std::size_t const pool_size = 4096;
+
+    json_corpus_options const options;
+    boost::uint64_t state;
+    std::vector<std::string> keys;
+    char pool[pool_size];
+    std::string record;
+};
+
+// The corpus as a string
+inline std::string generate_json(json_corpus_options const& options, std::size_t size)
+{
+    json_writer out;
+    json_generator(options).generate(out, size);
+    return std::string(out.data(), out.size());
+}
+
+// Throws std::invalid_argument for an unknown option
+inline bool parse_corpus_option(char const* arg, json_corpus_options& options, char const*& output)
+{
+    char const* const value = std::strchr(arg, '=');
+    std::string const name(arg, value ? value : arg + std::strlen(arg));
+    char const* const v = value ? value + 1 : "";
+
+    if (name == "--seed")
+        options.seed = std::strtoull(v, 0, 10);
+    else if (name == "--ndjson")
+        options.ndjson = true;
+    else if (name == "--depth")
+        options.depth = std::atoi(v);
+    else if (name == "--width")
+        options.width = std::atoi(v);
+    else if (name == "--keys")
+        options.keys = std::atoi(v);
+    else if (name == "--string-length")
+        options.string_length = std::atof(v);
+    else if (name == "--escapes")
+        options.escapes = std::atof(v);
+    else if (name == "--numbers")
+    {
+        if (std::sscanf(v, "%u,%u,%u", &options.integers, &options.decimals, &options.exponents) != 3)
+            throw std::invalid_argument("--numbers takes three weights, like 6,3,1");
+    }
+    else if (name == "--output")
+        output = v;
+    else
+        return false;
+    return true;
+}
+
+inline int generate_main(int const argc, char const* argv[])
+{
+    json_corpus_options options;
+    char const* output = 0;
+    char const* size = 0;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strncmp(argv[i], "--", 2) != 0)
+                size = argv[i];
+            else if (!parse_corpus_option(argv[i], options, output))
+                throw std::invalid_argument(std::string("unknown option ") + argv[i]);
+        }
+        if (!size)
+            throw std::invalid_argument("no size given");
+
+        int const fd = output ? ::open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 1;
+        if (fd < 0)
+            throw std::runtime_error(std::string("can't open ") + output);
+        {
+            json_writer out(json_writer::compact, fd);
+            json_generator(options).generate(out, parse_size(size));
+            out.flush();
+        }
+        if (output)
+            ::close(fd);
+    }
+    catch (std::exception const& e)
+    {
+        std::fprintf(stderr, "generate: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef BUILD_GENERATE_TEST
+# include <iostream>
+
+// Counts the kinds of value in a tree
+struct census : boost::static_visitor<>
+{
+    census() : integers(0), floats(0), strings(0), depth(0), deepest(0) {}
+
+    template <class T> void operator()(T const&) {}
+    void operator()(json_integer) { ++integers; }
+    void operator()(json_float) { ++floats; }
+    void operator()(json_string const&) { ++strings; }
+
+    void operator()(json_array const& a)
+    {
+        enter();
+        BOOST_FOREACH(json_value const& v, a)
+            boost::apply_visitor(*this, v);
+        --depth;
+    }
+
+    void operator()(json_object const& o)
+    {
+        enter();
+        BOOST_FOREACH(json_object::value_type const& m, o)
+            boost::apply_visitor(*this, m.second);
+        --depth;
+    }
+
+    void enter()
+    {
+        deepest = std::max(deepest, ++depth);
+    }
+
+    std::size_t integers, floats, strings;
+    unsigned depth, deepest;
+};
+
+// Every line is a valid record of exactly the given depth
+void check_ndjson(std::string const& text, unsigned depth, json_atom_table& atoms)
+{
+    std::size_t records = 0;
+    for (std::size_t start = 0; start < text.size(); ++records)
+    {
+        std::size_t const end = text.find('\n', start);
+        assert(end != std::string::npos);
+        assert(validate_json(text.data() + start, text.data() + end));
+        token_iterator toks = tokens(text.data() + start, text.data() + end);
+        census c;
+        boost::apply_visitor(c, parse_json_value(toks, atoms));
+        assert(c.deepest == depth);
+        start = end + 1;
+    }
+    assert(records > 1);
+}
+
+int main(int const argc, char const* argv[])
+{
+    if (argc > 1)
+        return generate_main(argc, argv);
+
+    json_corpus_options options;
+    std::string const text = generate_json(options, 64 << 10);
+    assert(text.size() >= 64 << 10 && text.size() < (64 << 10) + (16 << 10));
+    assert(text[0] == '[' && text[text.size() - 1] == ']');
+    assert(validate_json(text));
+    {
+        token_iterator toks = tokens(text);
+        census c;
+        boost::apply_visitor(c, parse_json_value(toks));
+        assert(c.deepest == options.depth + 1);
+        assert(c.integers > c.floats && c.floats > 0 && c.strings > 0);
+    }
+
+    // Reproducible from the seed alone
+    assert(generate_json(options, 64 << 10) == text);
+    options.seed = 2;
+    assert(generate_json(options, 64 << 10) != text);
+
+    // Tiny documents are still whole
+    assert(validate_json(generate_json(options, 0)));
+
+    // Deep, narrow records with few keys, no escapes and only integers
+    options.ndjson = true;
+    options.depth = 40;
+    options.width = 1;
+    options.keys = 3;
+    options.escapes = 0;
+    options.integers = 1;
+    options.decimals = options.exponents = 0;
+    std::string const narrow = generate_json(options, 256 << 10);
+    assert(narrow.find('\\') == std::string::npos);
+    json_atom_table narrow_keys;
+    check_ndjson(narrow, 40, narrow_keys);
+    assert(narrow_keys.size() == 3);
+    {
+        token_iterator toks = tokens(narrow.data(), narrow.data() + narrow.find('\n'));
+        census c;
+        boost::apply_visitor(c, parse_json_value(toks));
+        assert(c.floats == 0);
+    }
+
+    // Long strings full of escapes decode to valid UTF-8
+    options.depth = 2;
+    options.width = 8;
+    options.keys = 10000;
+    options.string_length = 200;
+    options.escapes = 0.3;
+    options.integers = 0;
+    options.exponents = 1;
+    std::string const escaped = generate_json(options, 256 << 10);
+    json_atom_table escaped_keys;
+    check_ndjson(escaped, 2, escaped_keys);
+    assert(escaped_keys.size() > 1000);
+    assert(std::count(escaped.begin(), escaped.end(), '\\') > 10000);
+
+    // Options from the command line
+    char const* output = 0;
+    json_corpus_options parsed;
+    assert(parse_corpus_option("--numbers=1,2,3", parsed, output) && parsed.decimals == 2);
+    assert(parse_corpus_option("--output=x.json", parsed, output) && std::string(output) == "x.json");
+    assert(!parse_corpus_option("--nonsense", parsed, output));
+    try
+    {
+        parsed.width = 0;
+        json_generator g(parsed);
+        assert(!"zero width not detected");
+    }
+    catch(std::invalid_argument const&) {}
+
+    std::cout << text.substr(0, 300) << "..." << std::endl;
+}
+#endif
@@ -0,0 +1,73 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures key interning over many small records with the same keys.
+// Each record parsed on its own gets a fresh set of keys; parsed with
+// one shared json_atom_table, all records share a single copy of each.
+// Counts heap allocations and the bytes still live once parsed.
+//
+//   ./intern_bench [records]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+#include "alloc_count.hpp"
+#include <vector>
+
+struct parse_records
+{
+    parse_records(std::vector<std::string> const& text, json_array& out, bool shared)
+      : text(text), out(out), shared(shared) {}
+
+    void operator()() const
+    {
+        json_atom_table atoms;
+        BOOST_FOREACH(std::string const& r, text)
+        {
+            token_iterator toks = tokens(r);
+            out.push_back(shared ? parse_json_value(toks, atoms) : parse_json_value(toks));
+        }
+    }
+
+    std::vector<std::string> const& text;
+    json_array& out;
+    bool shared;
+};
+
+void run(char const* what, std::vector<std::string> const& text, std::size_t bytes, bool shared)
+{
+    json_array records;
+    records.reserve(text.size());
+    std::size_t const allocations = counting::allocations;
+    std::size_t const live = counting::live_bytes;
+    double const t = time_it(parse_records(text, records, shared));
+    report(what, t, bytes);
+    std::printf("%28s %9.2f allocations/record, %6.0f bytes/record live\n", "",
+                double(counting::allocations - allocations) / text.size(),
+                double(counting::live_bytes - live) / text.size());
+}
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const count = parse_size(argc > 1 ? argv[1] : "100k");
+
+    std::vector<std::string> text;
+    std::size_t bytes = 0;
+    char buffer[512];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::sprintf(buffer,
+                     "{\"timestamp\": %lu, \"event_type\": \"click\", \"user\": %lu,"
+                     " \"session_identifier\": \"s%lu\", \"referrer_document_location\": null,"
+                     " \"client\": {\"user_agent_family\": \"Firefox\", \"screen_resolution_width\": 1280,"
+                     " \"screen_resolution_height\": 800, \"is_mobile\": false}}",
+                     (unsigned long)(1350000000 + i), (unsigned long)(i % 977),
+                     (unsigned long)(i / 10));
+        text.push_back(buffer);
+        bytes += text.back().size();
+    }
+
+    run("key per record", text, bytes, false);
+    run("keys shared", text, bytes, true);
+}
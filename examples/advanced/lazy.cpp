@@ -0,0 +1,240 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// A lazily decoded JSON document.  Construction validates and
+// tokenizes the whole text up front, and links every '[' and '{' to
+// the token after its matching close; that pass is O(n), and keeps a
+// token and a link for every token in the input, 32 bytes each on a
+// 64-bit target.  After that a lazy_value is just a document and a
+// token index: looking up a member or element hops over its siblings
+// in one step each, without allocating, and only decode() builds
+// json_values, for just the subtree asked for.  So it pays for
+// documents that are queried many times, not for one lookup.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_LAZY_TEST
+#endif
+
+#include "parse.cpp"
+#include "validate.cpp"
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <stdexcept>
+#include <cstring>
+#include <vector>
+
+class lazy_value;
+
+class lazy_document : boost::noncopyable
+{
+ public:
+    // The text must outlive the document; throws json_lex_error if it
+    // isn't valid JSON
+    lazy_document(char const* first, char const* last)
+    {
+        init(first, last);
+    }
+
+    explicit lazy_document(file_source const& f)
+    {
+        init(f.begin(), f.end());
+    }
+
+    lazy_value root() const;
+
+ private:
+    friend class lazy_value;
+
+    void init(char const* first, char const* last)
+    {
+        json_validation const v = validate_json(first, last);
+        if (!v)
+            throw json_lex_error(v.offset);
+
+        std::vector<std::size_t> open;
+        BOOST_FOREACH(token const& t, std::make_pair(tokens(first, last), token_iterator()))
+        {
+            std::size_t const i = toks.size();
+            toks.push_back(t);
+            next.push_back(i + 1);
+            if (*t.first == '[' || *t.first == '{')
+            {
+                open.push_back(i);
+            }
+            else if (*t.first == ']' || *t.first == '}')
+            {
+                next[open.back()] = i + 1;
+                open.pop_back();
+            }
+        }
+    }
+
+    std::vector<token> toks;
+    std::vector<std::size_t> next;  // index of the token after each value
+};
+
+class lazy_value
+{
+ public:
+    bool is_object() const { return first_char() == '{'; }
+    bool is_array() const { return first_char() == '['; }
+    bool is_string() const { return first_char() == '"'; }
+    bool is_null() const { return first_char() == 'n'; }
+
+    // The value's text, for scalars
+    token const& text() const { return doc->toks[index]; }
+
+    // Number of members or elements
+    std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (std::size_t i = first_child(); i; i = next_child(i))
+            ++n;
+        return n;
+    }
+
+    // The element at position n of an array
+    lazy_value operator[](std::size_t n) const
+    {
+        if (!is_array())
+            throw std::invalid_argument("lazy_value: not an array");
+        for (std::size_t i = first_child(); i; i = next_child(i), --n)
+        {
+            if (n == 0)
+                return lazy_value(doc, i);
+        }
+        throw std::out_of_range("lazy_value: array index out of range");
+    }
+
+    // Without this, v[0] would be ambiguous
+    lazy_value operator[](int n) const
+    {
+        return (*this)[std::size_t(n)];
+    }
+
+    // The member named key of an object; as with json_object, the last
+    // of several members with the same key wins
+    boost::optional<lazy_value> find(char const* key) const
+    {
+        if (!is_object())
+            throw std::invalid_argument("lazy_value: not an object");
+
+        boost::optional<lazy_value> result;
+        std::size_t const key_length = std::strlen(key);
+        for (std::size_t i = first_child(); i; i = next_child(i))
+        {
+            if (key_equals(doc->toks[i], key, key_length))
+                result = lazy_value(doc, i + 2);
+        }
+        return result;
+    }
+
+    lazy_value operator[](char const* key) const
+    {
+        boost::optional<lazy_value> v = find(key);
+        if (!v)
+            throw std::out_of_range(std::string("lazy_value: no member ") + key);
+        return *v;
+    }
+
+    // Build the json_value for this subtree
+    json_value decode() const
+    {
+        std::vector<token>::const_iterator t = doc->toks.begin() + index;
+        return parse_json_value(t);
+    }
+
+ private:
+    friend class lazy_document;
+
+    lazy_value(lazy_document const* doc, std::size_t index)
+      : doc(doc), index(index)
+    {}
+
+    char first_char() const { return *doc->toks[index].first; }
+
+    // The first element, or the key of the first member; 0 if none
+    std::size_t first_child() const
+    {
+        if (!is_array() && !is_object())
+            return 0;
+        std::size_t const i = index + 1;
+        return *doc->toks[i].first == ']' || *doc->toks[i].first == '}' ? 0 : i;
+    }
+
+    // The element or member key following the one at i; 0 if none
+    std::size_t next_child(std::size_t i) const
+    {
+        std::size_t const after = doc->next[is_object() ? i + 2 : i];
+        return *doc->toks[after].first == ',' ? after + 1 : 0;
+    }
+
+    // Compare a key token with key; only keys with escapes are copied
+    static bool key_equals(token const& t, char const* key, std::size_t length)
+    {
+        std::string scratch;
+        string_span const k = decode_json_string(t, scratch);
+        return std::size_t(k.size()) == length && std::memcmp(k.begin(), key, length) == 0;
+    }
+
+    lazy_document const* doc;
+    std::size_t index;
+};
+
+inline lazy_value lazy_document::root() const
+{
+    return lazy_value(this, 0);
+}
+
+#ifdef BUILD_LAZY_TEST
+# include <iostream>
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    lazy_document const doc(input.begin(), input.end());
+
+    token_iterator toks = tokens(input);
+    json_value const everything = parse_json_value(toks);
+    assert(doc.root().decode() == everything);
+
+    lazy_value const servlets = doc.root()["web-app"]["servlet"];
+    assert(servlets.is_array() && servlets.size() == 5);
+
+    json_value const track = servlets[0]["init-param"]["cachePagesTrack"].decode();
+    std::cout << "cachePagesTrack: " << track << std::endl;
+    assert(track == json_value(200));
+
+    assert(servlets[4]["servlet-name"].decode() == json_value("cofaxTools"));
+    assert(!doc.root()["web-app"].find("no-such-key"));
+
+    char const text[] = "{\"a\\/b\": [1, [2, 3], {}], \"x\": null, \"x\": \"last\"}";
+    lazy_document const small(text, text + sizeof(text) - 1);
+    assert(small.root().size() == 3);
+    assert(small.root()["a/b"][1][1].decode() == json_value(3));
+    assert(small.root()["a/b"][2].size() == 0);
+    assert(small.root()["x"].decode() == json_value("last"));
+
+    try
+    {
+        small.root()["a/b"][3];
+        assert(!"index out of range not detected");
+    }
+    catch(std::out_of_range const&) {}
+
+    try
+    {
+        char const bad[] = "[1, 2";
+        lazy_document const d(bad, bad + sizeof(bad) - 1);
+        assert(!"bad document not detected");
+    }
+    catch(json_lex_error const& e)
+    {
+        assert(e.offset == 5);
+    }
+}
+#endif
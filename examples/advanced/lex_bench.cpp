@@ -0,0 +1,81 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the xpressive tokenizer with the table-driven one.
+//
+//   ./lex_bench [size [file]]
+//
+// builds a JSON array of copies of file (default test.json) until it is
+// at least size bytes (default 16M; try 1G), then times each lexer over it.
+// The structural index pass is timed alone and together with a walk of
+// its tokens.
+
+#define NO_TEST
+#include "structural_index.cpp"
+#include "bench.hpp"
+#include <stdexcept>
+
+template <class Iterator>
+struct count_tokens
+{
+    count_tokens(Iterator first, std::size_t& n) : first(first), n(n) {}
+
+    void operator()() const
+    {
+        n = 0;
+        for (Iterator i = first; i != Iterator(); ++i)
+            ++n;
+    }
+
+    Iterator first;
+    std::size_t& n;
+};
+
+struct build_index
+{
+    build_index(char const* first, char const* last) : first(first), last(last) {}
+
+    void operator()() const
+    {
+        structural_index idx(first, last);
+        keep(idx.offsets().size());
+    }
+
+    char const* first;
+    char const* last;
+};
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const size = parse_size(argc > 1 ? argv[1] : "16M");
+    file_source doc(argc > 2 ? argv[2] : "test.json");
+
+    std::string const text = scale(doc.begin(), doc.end(), size);
+    char const* const first = text.data();
+    char const* const last = first + text.size();
+
+    std::size_t n_regex = 0, n_table = 0;
+    double const t_regex = time_it(
+        count_tokens<regex_token_iterator>(regex_tokens(first, last), n_regex));
+    double const t_table = time_it(
+        count_tokens<token_iterator>(tokens(first, last), n_table));
+
+    double const t_index = time_it(build_index(first, last));
+    structural_index const idx(first, last);
+    std::size_t n_indexed = 0;
+    double const t_walk = time_it(
+        count_tokens<indexed_token_iterator>(tokens(idx), n_indexed));
+
+    if (n_regex != n_table || n_indexed != n_table)
+        throw std::logic_error("lexers disagree on the token count");
+
+    std::printf("%lu bytes, %lu tokens\n",
+                (unsigned long)text.size(), (unsigned long)n_table);
+    report("xpressive regex", t_regex, text.size());
+    report("table-driven", t_table, text.size());
+    report("structural index", t_index, text.size());
+    report("structural index + walk", t_index + t_walk, text.size());
+    std::printf("speedup over regex: %.1fx table, %.1fx indexed\n",
+                t_regex / t_table, t_regex / (t_index + t_walk));
+}
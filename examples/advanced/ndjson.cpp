@@ -0,0 +1,237 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// Newline-delimited JSON: one value per line.  parse_ndjson() cuts
+// the input into chunks at line boundaries, parses the chunks on a
+// group of threads, and returns the records in input order.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_NDJSON_TEST
+#endif
+
+#include "parse.cpp"
+#include "validate.cpp"
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/bind/bind.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace ndjson
+{
+  // The records of one chunk, and the first error parsing them, if
+  // any, with the absolute offset of the record that raised it
+  struct chunk
+  {
+      chunk() : first(0), last(0), error_offset(0) {}
+
+      char const* first;
+      char const* last;
+      json_array records;
+      boost::exception_ptr error;
+      std::size_t error_offset;
+  };
+
+  inline char const* next_line(char const* p, char const* last)
+  {
+      char const* const newline = static_cast<char const*>(std::memchr(p, '\n', last - p));
+      return newline ? newline + 1 : last;
+  }
+
+  inline void fail(chunk* c, boost::exception_ptr const& error, std::size_t offset)
+  {
+      c->error = error;
+      c->error_offset = offset;
+  }
+
+  // Parse each non-blank line of c; start is the beginning of the
+  // whole input, for error offsets.  The records share their keys and
+  // the parser's stack.  Each line is validated first, so that a bad
+  // record is reported as a json_lex_error at its offset, which the
+  // parser doesn't track; validation allocates nothing.  This runs on
+  // a worker thread, so whatever it throws is kept in c, and the
+  // caller rethrows it.
+  inline void parse_chunk(char const* start, chunk* c)
+  {
+      char const* line = c->first;
+      try
+      {
+          json_atom_table atoms;
+          json_parser parser;
+          while (line != c->last)
+          {
+              char const* const end = next_line(line, c->last);
+
+              char const* p = line;
+              while (p != end && (lex::flags[(unsigned char)*p] & lex::space))
+                  ++p;
+              if (p != end)
+              {
+                  json_validation const v = validate_json(line, end);
+                  if (!v)
+                      throw json_lex_error(line - start + v.offset);
+                  token_iterator toks = tokens(line, end);
+                  c->records.push_back(parser.parse(toks, atoms));
+              }
+              line = end;
+          }
+      }
+      // current_exception() keeps only the standard base of a type it
+      // doesn't know, so the parser's own errors are copied as they are
+      catch(json_lex_error const& e)
+      {
+          fail(c, boost::copy_exception(e), line - start);
+      }
+      catch(json_depth_error const& e)
+      {
+          fail(c, boost::copy_exception(e), line - start);
+      }
+      catch(...)
+      {
+          fail(c, boost::current_exception(), line - start);
+      }
+  }
+
+  // Parse chunks, taking the next one not yet taken from *next, until
+  // there are none left
+  inline void worker(char const* start, std::vector<chunk>* chunks,
+                     boost::atomic<std::size_t>* next)
+  {
+      for (std::size_t i; (i = next->fetch_add(1, boost::memory_order_relaxed)) < chunks->size();)
+          parse_chunk(start, &(*chunks)[i]);
+  }
+}
+
+// Parse [first, last) as newline-delimited JSON using up to threads
+// threads (0 means one per core); blank lines are skipped.  Throws
+// json_lex_error, with the offset in the whole input, for the first
+// bad record, or whatever else parsing the first record that fails
+// throws, e.g. std::range_error for a number too large.
+inline json_array parse_ndjson(char const* first, char const* last, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+
+    // Several chunks per thread, handed out as threads come free, so
+    // one slow chunk doesn't idle the rest
+    std::size_t const target = std::max<std::size_t>(1, threads * 4);
+    std::size_t const chunk_size = std::max<std::size_t>(1, (last - first) / target);
+
+    std::vector<ndjson::chunk> chunks;
+    for (char const* p = first; p != last;)
+    {
+        ndjson::chunk c;
+        c.first = p;
+        c.last = ndjson::next_line(
+            std::size_t(last - p) > chunk_size ? p + chunk_size : last, last);
+        chunks.push_back(c);
+        p = c.last;
+    }
+
+    boost::atomic<std::size_t> next(0);
+    if (threads == 1 || chunks.size() <= 1)
+    {
+        ndjson::worker(first, &chunks, &next);
+    }
+    else
+    {
+        boost::thread_group group;
+        for (unsigned t = 0; t < threads; ++t)
+            group.create_thread(boost::bind(&ndjson::worker, first, &chunks, &next));
+        group.join_all();
+    }
+
+    std::size_t total = 0;
+    BOOST_FOREACH(ndjson::chunk const& c, chunks)
+    {
+        if (c.error)
+            boost::rethrow_exception(c.error);
+        total += c.records.size();
+    }
+
+    json_array result;
+    result.reserve(total);
+    BOOST_FOREACH(ndjson::chunk& c, chunks)
+    {
+        BOOST_FOREACH(json_value& v, c.records)
+            result.push_back(MOVE(v));
+    }
+    return result;
+}
+
+inline json_array parse_ndjson(file_source const& f, unsigned threads = 0)
+{
+    return parse_ndjson(f.begin(), f.end(), threads);
+}
+
+#ifdef BUILD_NDJSON_TEST
+# include <iostream>
+# include <sstream>
+
+int main(int const argc, char const* argv[])
+{
+    if (argc > 1)
+    {
+        file_source input(argv[1]);
+        std::cout << parse_ndjson(input).size() << " records" << std::endl;
+        return 0;
+    }
+
+    std::ostringstream text;
+    json_array expected;
+    for (int i = 0; i < 1000; ++i)
+    {
+        json_object o;
+        o["id"] = i;
+        o["name"] = "record";
+        json_array a;
+        a.push_back(i % 7 == 0);
+        a.push_back(json_null());
+        o["tags"] = a;
+        expected.push_back(o);
+
+        text << "{\"id\": " << i << ", \"name\": \"record\", \"tags\": ["
+             << (i % 7 == 0 ? "true" : "false") << ", null]}"
+             << (i % 10 == 0 ? "\r\n\n" : "\n");
+    }
+    std::string const s = text.str();
+
+    for (unsigned threads = 1; threads <= 8; threads *= 2)
+        assert(parse_ndjson(s.data(), s.data() + s.size(), threads) == expected);
+
+    // No trailing newline
+    char const two[] = "1\n[2]";
+    json_array const records = parse_ndjson(two, two + sizeof(two) - 1, 2);
+    assert(records.size() == 2 && records[0] == json_value(1));
+
+    try
+    {
+        std::string const bad = s + "{\"id\": 1000,}\n" + s;
+        parse_ndjson(bad.data(), bad.data() + bad.size(), 4);
+        assert(!"bad record not detected");
+    }
+    catch(json_lex_error const& e)
+    {
+        assert(e.offset == s.size() + 12);
+    }
+
+    // Errors on worker threads reach the caller, the first in input
+    // order
+    for (unsigned threads = 1; threads <= 4; threads *= 2)
+    {
+        try
+        {
+            std::string const huge = s + "[1e99999]\n" + s + "{\"id\": 1,}\n";
+            parse_ndjson(huge.data(), huge.data() + huge.size(), threads);
+            assert(!"number out of range not detected");
+        }
+        catch(std::range_error const&) {}
+    }
+}
+#endif
@@ -0,0 +1,60 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Records per second from parse_ndjson() against thread count.
+//
+//   ./ndjson_bench [size [file]]
+//
+// repeats file (default test.json), flattened onto one line, as records
+// until the input is at least size bytes (default 16M).
+
+#define NO_TEST
+#include "ndjson.cpp"
+#include "bench.hpp"
+#include <algorithm>
+
+struct parse_all
+{
+    parse_all(std::string const& text, unsigned threads, std::size_t& records)
+      : text(text), threads(threads), records(records) {}
+
+    void operator()() const
+    {
+        records = parse_ndjson(text.data(), text.data() + text.size(), threads).size();
+    }
+
+    std::string const& text;
+    unsigned threads;
+    std::size_t& records;
+};
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const size = parse_size(argc > 1 ? argv[1] : "16M");
+    file_source doc(argc > 2 ? argv[2] : "test.json");
+
+    // JSON strings can't contain raw newlines, so this keeps it valid
+    std::string record(doc.begin(), doc.end());
+    std::replace(record.begin(), record.end(), '\n', ' ');
+    record += '\n';
+
+    std::string text;
+    text.reserve(size + record.size());
+    while (text.size() < size)
+        text += record;
+
+    unsigned const cores = std::max(1u, boost::thread::hardware_concurrency());
+    std::printf("%lu bytes, %u cores\n", (unsigned long)text.size(), cores);
+
+    double base = 0;
+    for (unsigned threads = 1; threads <= std::max(8u, 2 * cores); threads *= 2)
+    {
+        std::size_t records = 0;
+        double const t = time_it(parse_all(text, threads, records));
+        if (threads == 1)
+            base = t;
+        std::printf("%2u threads %10.0f records/s %6.2fx\n",
+                    threads, records / t, base / t);
+    }
+}
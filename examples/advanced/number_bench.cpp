@@ -0,0 +1,99 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares decode_json_number() with the boost::lexical_cast conversion
+// parse_json_number() used to do, over a telemetry-like array of
+// integers, decimals and exponents.
+//
+//   ./number_bench [count]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <stdexcept>
+#include <vector>
+
+// The old conversion, which also took "1e5" for an integer
+json_value lexical_number(token const& tok)
+{
+    if (boost::contains(tok, "."))
+        return boost::lexical_cast<json_float>(tok);
+    else
+        return boost::lexical_cast<json_integer>(tok);
+}
+
+json_value fast_number(token const& tok)
+{
+    json_integer i;
+    json_float f;
+    if (decode_json_number(tok.first, tok.second, i, f))
+        return i;
+    else
+        return f;
+}
+
+struct convert_all
+{
+    typedef json_value (*converter)(token const&);
+
+    convert_all(std::vector<token> const& numbers, converter convert)
+      : numbers(numbers), convert(convert) {}
+
+    void operator()() const
+    {
+        BOOST_FOREACH(token const& t, numbers)
+            keep(convert(t));
+    }
+
+    std::vector<token> const& numbers;
+    converter convert;
+};
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const count = parse_size(argc > 1 ? argv[1] : "1M");
+
+    // Only forms the old conversion handled: no exponents
+    std::string text = "[";
+    char buffer[64];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        switch (i % 4)
+        {
+        case 0: std::sprintf(buffer, "%lu", (unsigned long)(i * 2654435761u % 100000)); break;
+        case 1: std::sprintf(buffer, "-%lu", (unsigned long)(i * 40503u % 1000000000)); break;
+        case 2: std::sprintf(buffer, "%lu.%02lu", (unsigned long)(i % 1000), (unsigned long)(i % 100)); break;
+        case 3: std::sprintf(buffer, "-0.%06lu", (unsigned long)(i * 7919 % 1000000)); break;
+        }
+        if (i)
+            text += ',';
+        text += buffer;
+    }
+    text += ']';
+
+    std::vector<token> numbers;
+    BOOST_FOREACH(token const& t, std::make_pair(tokens(text), token_iterator()))
+    {
+        if (*t.first != '[' && *t.first != ',' && *t.first != ']')
+            numbers.push_back(t);
+    }
+
+    BOOST_FOREACH(token const& t, numbers)
+    {
+        if (lexical_number(t) != fast_number(t))
+            throw std::logic_error("conversions disagree on " + t.str());
+    }
+
+    double const t_lexical = time_it(convert_all(numbers, lexical_number));
+    double const t_fast = time_it(convert_all(numbers, fast_number));
+
+    std::printf("%lu numbers, %lu bytes\n", (unsigned long)numbers.size(), (unsigned long)text.size());
+    report("boost::lexical_cast", t_lexical, text.size());
+    report("decode_json_number", t_fast, text.size());
+    std::printf("%.1f vs %.1f ns/number, speedup %.1fx\n",
+                t_lexical / numbers.size() * 1e9, t_fast / numbers.size() * 1e9,
+                t_lexical / t_fast);
+}
@@ -0,0 +1,142 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Parses single objects of growing size, with keys in random order,
+// comparing sorting the members once, hashing them once, and inserting
+// them one at a time as parse_json_object() used to; then times
+// looking each key up in the sorted and the hashed object, to show
+// where json_object::default_hash_threshold should be.
+//
+//   ./object_bench [largest]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+
+// The old way: o[key] = value, an O(n) shift per member until the
+// object switches to a hash index
+json_value insert_each(std::string const& text)
+{
+    json_atom_table atoms;
+    token_iterator toks = tokens(text);
+    json_object o;
+    std::string scratch;
+    ++toks;                     // {
+    while (*toks->first != '}')
+    {
+        if (!o.empty())
+            ++toks;             // ,
+        string_span const s = decode_json_string(*toks++, scratch);
+        json_key k = atoms.intern(s.begin(), s.end());
+        ++toks;                 // :
+        o[MOVE(k)] = parse_json_value(toks, atoms);
+    }
+    return MOVE(o);
+}
+
+json_value parse_with(std::string const& text, std::size_t hash_threshold)
+{
+    json_atom_table atoms;
+    token_iterator toks = tokens(text);
+    return json_parser(json_parser::default_max_depth, hash_threshold).parse(toks, atoms);
+}
+
+json_value sort_once(std::string const& text)
+{
+    return parse_with(text, std::size_t(-1));
+}
+
+json_value hash_once(std::string const& text)
+{
+    return parse_with(text, 0);
+}
+
+// Finds every key of o, many times over
+struct find_each : boost::static_visitor<>
+{
+    find_each(std::vector<json_key> const& keys, int repeat) : keys(keys), repeat(repeat) {}
+
+    template <class T>
+    void operator()(T const&) const {}
+
+    void operator()(json_object const& o) const
+    {
+        for (int i = 0; i < repeat; ++i)
+        {
+            BOOST_FOREACH(json_key const& k, keys)
+                keep(o.find(k)->second);
+        }
+    }
+
+    std::vector<json_key> const& keys;
+    int repeat;
+};
+
+struct look_up
+{
+    look_up(json_value const& v, std::vector<json_key> const& keys, int repeat)
+      : v(v), keys(keys), repeat(repeat) {}
+
+    void operator()() const
+    {
+        find_each f(keys, repeat);
+        boost::apply_visitor(f, v);
+    }
+
+    json_value const& v;
+    std::vector<json_key> const& keys;
+    int repeat;
+};
+
+struct parse_repeatedly
+{
+    typedef json_value (*parser)(std::string const&);
+
+    parse_repeatedly(std::string const& text, parser parse, int repeat)
+      : text(text), parse(parse), repeat(repeat) {}
+
+    void operator()() const
+    {
+        for (int i = 0; i < repeat; ++i)
+            keep(parse(text));
+    }
+
+    std::string const& text;
+    parser parse;
+    int repeat;
+};
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const largest = parse_size(argc > 1 ? argv[1] : "16k");
+
+    std::printf("%8s %14s %14s %14s %14s %14s\n", "members",
+                "insert each", "sort once", "hash once", "sorted find", "hashed find");
+    for (std::size_t n = 8; n <= largest; n *= 4)
+    {
+        std::string text = "{";
+        std::vector<json_key> keys;
+        char buffer[64];
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            // Distinct keys in a scrambled order
+            std::sprintf(buffer, "%s\"key%08lx\": %lu", i ? ", " : "",
+                         (unsigned long)(i * 2654435761u % 4294967291u), (unsigned long)i);
+            text += buffer;
+            keys.push_back(json_key(buffer + (i ? 3 : 1), buffer + (i ? 14 : 12)));
+        }
+        text += "}";
+
+        int const repeat = int(std::max<std::size_t>(1, (1 << 16) / n));
+        json_value const sorted = sort_once(text), hashed = hash_once(text);
+        assert(insert_each(text) == sorted && hashed == sorted);
+        double const inserting = time_it(parse_repeatedly(text, insert_each, repeat)) / repeat;
+        double const sorting = time_it(parse_repeatedly(text, sort_once, repeat)) / repeat;
+        double const hashing = time_it(parse_repeatedly(text, hash_once, repeat)) / repeat;
+        double const bisecting = time_it(look_up(sorted, keys, repeat)) / repeat / n;
+        double const probing = time_it(look_up(hashed, keys, repeat)) / repeat / n;
+        std::printf("%8lu %11.1f us %11.1f us %11.1f us %11.1f ns %11.1f ns\n", (unsigned long)n,
+                    inserting * 1e6, sorting * 1e6, hashing * 1e6, bisecting * 1e9, probing * 1e9);
+    }
+}
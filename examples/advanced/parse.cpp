@@ -7,157 +7,1056 @@
 # define BUILD_PARSE_TEST
 #endif
 
-#include "tokenize.cpp"
+#include "structural_index.cpp"
 #include "variant.cpp"
 #include <boost/range.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/functional.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/predicate.hpp>
+#include <boost/container/vector.hpp>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <locale.h>
 
-json_value parse_json_value(token_iterator& tokens);
+// The text of a key or string value, borrowed from the input or from
+// a scratch buffer
+typedef boost::iterator_range<char const*> string_span;
 
-inline std::string first_token_text(token_iterator const& tokens)
+template <class TokenIterator>
+inline std::string first_token_text(TokenIterator const& tokens)
 {
     return std::string(tokens->first, tokens->second);
 }
 
-inline void parse_literal(char const* text, token_iterator& tokens)
+// The first character of the next token.  The token past the last
+// has no text, so truncated input throws here.
+template <class TokenIterator>
+inline char next_token_char(TokenIterator const& tokens)
 {
+    if (!tokens->first)
+        throw std::invalid_argument("unexpected end of JSON input");
+    return *tokens->first;
+}
+
+// Consume the next token, which must be text
+template <class TokenIterator>
+inline void parse_literal(char const* text, TokenIterator& tokens)
+{
+    next_token_char(tokens);
     LOG("parse_literal: " << text << " vs " << first_token_text(tokens));
-    assert(boost::equal(boost::as_literal(text), *tokens));
+    if (!boost::equal(boost::as_literal(text), *tokens))
+        throw std::invalid_argument(
+            "expected " + std::string(text) + " in JSON, found " + first_token_text(tokens));
     ++tokens;
 }
     
-inline json_string parse_json_string(token_iterator& tokens)
+// Writes the UTF-8 encoding of code point c at out; returns the end
+inline char* encode_utf8(unsigned long c, char* out)
+{
+    if (c < 0x80)
+    {
+        *out++ = char(c);
+    }
+    else if (c < 0x800)
+    {
+        *out++ = char(0xC0 | c >> 6);
+        *out++ = char(0x80 | c & 0x3F);
+    }
+    else if (c < 0x10000)
+    {
+        *out++ = char(0xE0 | c >> 12);
+        *out++ = char(0x80 | c >> 6 & 0x3F);
+        *out++ = char(0x80 | c & 0x3F);
+    }
+    else
+    {
+        *out++ = char(0xF0 | c >> 18);
+        *out++ = char(0x80 | c >> 12 & 0x3F);
+        *out++ = char(0x80 | c >> 6 & 0x3F);
+        *out++ = char(0x80 | c & 0x3F);
+    }
+    return out;
+}
+
+inline unsigned long decode_hex4(char const* p)
+{
+    unsigned long c = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        unsigned char const d = p[i];
+        c = c * 16 + (d <= '9' ? d - '0' : (d | 0x20) - 'a' + 10);
+    }
+    return c;
+}
+
+// Decode the escapes in [out, last) in place, and return the new end.
+// out must point at the first backslash.  Every escape is at least as
+// long as its decoding, so the output never overtakes the input.
+// The lexer has already checked the escapes; an unpaired surrogate
+// becomes U+FFFD.
+inline char* unescape_in_place(char* out, char const* last)
+{
+    char const* in = out;
+    while (in != last)
+    {
+        ++in;                       // the backslash
+        char const c = *in++;
+        switch (c)
+        {
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+        {
+            unsigned long code = decode_hex4(in);
+            in += 4;
+            if (code >= 0xD800 && code < 0xDC00
+                && last - in >= 6 && in[0] == '\\' && in[1] == 'u')
+            {
+                unsigned long const low = decode_hex4(in + 2);
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    in += 6;
+                }
+            }
+            if (code >= 0xD800 && code < 0xE000)
+                code = 0xFFFD;
+            out = encode_utf8(code, out);
+            break;
+        }
+        default:                    // " \ /
+            *out++ = c;
+        }
+
+        char const* const run = simd::find_backslash(in, last);
+        std::memmove(out, in, run - in);
+        out += run - in;
+        in = run;
+    }
+    return out;
+}
+
+// The decoded text of a string token.  Without escapes that is just
+// the bytes between the quotes, borrowed from the input; otherwise the
+// text is decoded into scratch.
+inline string_span decode_json_string(token const& t, std::string& scratch)
+{
+    char const* const first = t.first + 1;
+    char const* const last = t.second - 1;
+    char const* const escape = simd::find_backslash(first, last);
+    if (escape == last)
+        return string_span(first, last);
+
+    scratch.assign(first, last);
+    char* const begin = &scratch[0];
+    char* const end = unescape_in_place(begin + (escape - first), begin + scratch.size());
+    return string_span(begin, end);
+}
+
+template <class TokenIterator>
+inline json_string parse_json_string(
+    TokenIterator& tokens, json_string::allocator_type alloc = json_string::allocator_type())
 {
     LOG("parse_json_string: " << first_token_text(tokens));
     
     token representation = *tokens++;
 
-    // Everything but the quotes
-    json_string s(++representation.first, --representation.second);
+    // Everything but the quotes, in one sized copy
+    char const* const first = representation.first + 1;
+    char const* const last = representation.second - 1;
+    json_string s(first, last, alloc);
+
+    char const* const escape = simd::find_backslash(first, last);
+    if (escape != last)
+    {
+        char* const begin = &s[0];
+        s.resize(unescape_in_place(begin + (escape - first), begin + s.size()) - begin);
+    }
+    return s;
+}
+
+// Build an object from its members in input order, in O(n log n)
+// rather than the O(n^2) of inserting them one by one.  Of several
+// members with the same key the last wins, as with o[key] = value.
+// The object adopts the members' buffer.  An object of hash_threshold
+// members or more keeps them in input order, and hashes their keys.
+inline json_object make_json_object(
+    json_object::sequence_type& members,
+    std::size_t hash_threshold = json_object::default_hash_threshold)
+{
+    typedef json_object::sequence_type::iterator iterator;
+
+    if (members.size() >= hash_threshold)
+    {
+        json_object o(members.get_allocator());
+        o.adopt_sequence(MOVE(members));
+        return MOVE(o);
+    }
 
-    json_string::iterator dst = std::find(s.begin(), s.end(), '\\');
-    json_string::iterator src = dst;
-    while (src != s.end())
+    // Objects usually arrive sorted, or are too small to matter
+    if (std::adjacent_find(members.begin(), members.end(),
+                           boost::not2(member_key_less())) != members.end())
     {
-        if (*src != '\\')
+        // Insertion sort is stable too, and std::stable_sort's
+        // temporary buffer dominates for small objects
+        if (members.size() <= 16)
         {
-            *dst = *src;
+            for (iterator i = members.begin() + 1; i < members.end(); ++i)
+            {
+                std::rotate(std::upper_bound(members.begin(), i, *i, member_key_less()),
+                            i, i + 1);
+            }
         }
         else
         {
-            ++src;
-            *dst = chars_needing_escape[
-                std::find(
-                    escape_suffixes,
-                    escape_suffixes+sizeof(escape_suffixes),
-                    *src) - escape_suffixes
-            ];
-            
+            std::stable_sort(members.begin(), members.end(), member_key_less());
         }
-        ++dst;
-        ++src;
+
+        iterator out = members.begin();
+        for (iterator i = members.begin(); i != members.end(); ++i)
+        {
+            if (i + 1 != members.end() && i->first == (i + 1)->first)
+                continue;
+            if (out != i)
+                *out = MOVE(*i);
+            ++out;
+        }
+        members.erase(out, members.end());
     }
-    s.erase(dst, src);
-    return s;
+
+    json_object o(members.get_allocator());
+    o.adopt_sequence(boost::container::ordered_unique_range, MOVE(members));
+    return MOVE(o);
 }
 
-inline json_value parse_json_array(token_iterator& tokens)
+namespace number
 {
-    LOG("parse_json_array: " << first_token_text(tokens));
-    
-    parse_literal("[", tokens);
-    
-    json_array a;
-    while (*tokens->first != ']')
-    {
-        if (!a.empty())
-            parse_literal(",", tokens);
-        a.push_back( parse_json_value(tokens) );
-    }
+  // Decimal digits that always fit in a boost::uint64_t
+  int const max_digits = 19;
+
+  // Mantissas below 2^mantissa_bits, and powers of ten up to
+  // 10^max_exact_pow10, are exact json_floats, so one multiply or
+  // divide of the two is correctly rounded (Clinger's fast path)
+  int const mantissa_bits = std::numeric_limits<json_float>::digits < 64
+      ? std::numeric_limits<json_float>::digits : 64;
+  int const max_exact_pow10 = mantissa_bits >= 64 ? 27 : 22;
+
+  struct powers_of_ten
+  {
+      powers_of_ten()
+      {
+          json_float p = 1;
+          for (int i = 0; i <= max_exact_pow10; ++i, p *= 10)
+              table[i] = p;
+      }
+
+      json_float table[max_exact_pow10 + 1];
+  };
 
-    parse_literal("]", tokens);
-    return a;
+  inline json_float pow10(int n)
+  {
+      static powers_of_ten const powers;
+      return powers.table[n];
+  }
+
+  // The slow path: strtold in the "C" locale, which rounds correctly
+  inline json_float convert(char const* first, char const* last)
+  {
+      static locale_t const c_locale = ::newlocale(LC_ALL_MASK, "C", 0);
+
+      char buffer[64];
+      std::string long_text;
+      char const* text = buffer;
+      if (std::size_t(last - first) < sizeof(buffer))
+      {
+          std::copy(first, last, buffer);
+          buffer[last - first] = 0;
+      }
+      else
+      {
+          long_text.assign(first, last);
+          text = long_text.c_str();
+      }
+
+      errno = 0;
+      json_float const x = ::strtold_l(text, 0, c_locale);
+      if (errno == ERANGE && std::fabs(x) > 1)
+          throw std::range_error("JSON number out of range: " + std::string(first, last));
+      return x;
+  }
 }
 
-inline json_value parse_json_object(token_iterator& tokens)
+// Decode the text of a number token.  Returns true, with the value in
+// i, for an integer that fits in json_integer; otherwise the value is
+// in f.  Numbers with a fraction or exponent are always floats, and
+// integers too large for json_integer become floats too.  Throws
+// std::range_error if the value is too large even for json_float.
+inline bool decode_json_number(
+    char const* const first, char const* const last, json_integer& i, json_float& f)
 {
-    LOG("parse_json_object: " << first_token_text(tokens));
-    
-    parse_literal("{", tokens);
-    
-    json_object o;
-    while (*tokens->first != '}')
+    char const* p = first;
+    bool const negative = *p == '-';
+    p += negative;
+
+    boost::uint64_t mantissa = 0;
+    int digits = 0;             // significant digits in mantissa
+    bool truncated = false;     // true if digits didn't fit in mantissa
+    int exponent = 0;
+
+    for (; p != last && unsigned(*p - '0') < 10; ++p)
     {
-        if (!o.empty())
-            parse_literal(",", tokens);
-        json_string s = parse_json_string(tokens);
-        parse_literal(":", tokens);
-        o[s] = parse_json_value(tokens);
+        if (digits < number::max_digits)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            truncated = true;
+            ++exponent;
+        }
+    }
+
+    bool is_float = false;
+    if (p != last && *p == '.')
+    {
+        is_float = true;
+        for (++p; p != last && unsigned(*p - '0') < 10; ++p)
+        {
+            if (digits < number::max_digits)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+            else
+            {
+                truncated |= *p != '0';
+            }
+        }
+    }
+
+    if (p != last)              // e or E
+    {
+        is_float = true;
+        ++p;
+        bool const negative_exponent = *p == '-';
+        p += *p == '-' || *p == '+';
+        int e = 0;
+        for (; p != last; ++p)
+        {
+            if (e < 100000)     // far beyond any finite json_float
+                e = e * 10 + (*p - '0');
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+
+    if (!is_float && !truncated)
+    {
+        boost::uint64_t const limit
+            = boost::uint64_t(std::numeric_limits<json_integer>::max()) + negative;
+        if (mantissa <= limit)
+        {
+            i = negative ? json_integer(0 - mantissa) : json_integer(mantissa);
+            return true;
+        }
     }
 
-    parse_literal("}", tokens);
-    return o;
+    if (!truncated
+        && (number::mantissa_bits >= 64 || mantissa >> number::mantissa_bits == 0)
+        && exponent >= -number::max_exact_pow10 && exponent <= number::max_exact_pow10)
+    {
+        json_float const m = json_float(mantissa);
+        f = exponent < 0 ? m / number::pow10(-exponent) : m * number::pow10(exponent);
+    }
+    else
+    {
+        f = number::convert(first + negative, last);
+    }
+    if (negative)
+        f = -f;
+    return false;
 }
 
-inline json_value parse_json_number(token_iterator& tokens)
+template <class TokenIterator>
+inline json_value parse_json_number(TokenIterator& tokens)
 {
     LOG("parse_json_number: " << first_token_text(tokens));
     
     token tok = *tokens++;
-    if (boost::contains(tok, "."))
-        return boost::lexical_cast<json_float>(tok);
+    json_integer i;
+    json_float f;
+    if (decode_json_number(tok.first, tok.second, i, f))
+        return i;
     else
-        return boost::lexical_cast<json_integer>(tok);
-}
-
-inline json_value parse_json_value(token_iterator& tokens)
-{
-    LOG("parse_json_value: " << first_token_text(tokens));
-
-    switch (*tokens->first)
-    {
-    case '[':
-        return parse_json_array(tokens);
-    case '{':
-        return parse_json_object(tokens);
-    case 'n':
-        ++tokens;
-        return json_null();
-    case 't':
-        ++tokens;
-        return true;
-    case 'f':
-        ++tokens;
-        return false;
-    case '"':
-        return parse_json_string(tokens);
-    case '-':
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-        return parse_json_number(tokens);
-    default:
-        assert(!"unknown token");
+        return f;
+}
+
+// Thrown when a document nests containers more deeply than the parser
+// allows
+struct json_depth_error : std::runtime_error
+{
+    json_depth_error(std::size_t max_depth)
+      : std::runtime_error("JSON nested more than "
+                           + boost::lexical_cast<std::string>(max_depth) + " deep"),
+        max_depth(max_depth)
+    {}
+
+    std::size_t max_depth;
+};
+
+// Parser events.  Handlers may derive from this and hide only the
+// events they want.  A string_span is valid only during the callback.
+struct json_handler
+{
+    void start_object() {}
+    void key(string_span) {}
+    void end_object() {}
+    void start_array() {}
+    void end_array() {}
+    void value(json_null) {}
+    void value(bool) {}
+    void value(json_integer) {}
+    void value(json_float) {}
+    void value(string_span) {}
+};
+
+// Builds a json_value tree from parser events; json_parser drives one
+// from tokens, and json_push_parser from text fed in chunks.  Open
+// containers live on an explicit stack rather than the call stack, so
+// nesting is limited only by max_depth, and a builder kept for many
+// documents reuses the stack.  Object keys are interned in a
+// json_atom_table, so each distinct key is stored once, and strings
+// and containers use its allocator, so a table over an arena puts the
+// whole tree there.  Objects of hash_threshold members or more are
+// hashed (see json_object); of several members with the same key, the
+// last wins.
+class json_tree_builder : public json_handler
+{
+ public:
+    // The limit validate_json() enforces
+    static std::size_t const default_max_depth = 4096;
+
+    explicit json_tree_builder(
+        json_atom_table& atoms, std::size_t max_depth = default_max_depth,
+        std::size_t hash_threshold = json_object::default_hash_threshold)
+      : atoms(&atoms), max_depth(max_depth), hash_threshold(hash_threshold), complete(false)
+    {}
+
+    // reset() must give it a table before the first event
+    explicit json_tree_builder(
+        std::size_t max_depth = default_max_depth,
+        std::size_t hash_threshold = json_object::default_hash_threshold)
+      : atoms(0), max_depth(max_depth), hash_threshold(hash_threshold), complete(false)
+    {}
+
+    // Start a new document, interning its keys in atoms
+    void reset(json_atom_table& a)
+    {
+        clear();
+        atoms = &a;
+    }
+
+    // Drop the document, and any partial containers, which may be in
+    // an arena that is about to go away
+    void clear()
+    {
+        stack.clear();
+        root = json_value();
+        complete = false;
+    }
+
+    void start_object() { open(true); }
+    void start_array() { open(false); }
+
+    void key(string_span k)
+    {
+        stack.back().key = atoms->intern(k.begin(), k.end());
+    }
+
+    void end_object()
+    {
+        json_value v(make_json_object(stack.back().members, hash_threshold));
+        stack.pop_back();
+        add(MOVE(v));
+    }
+
+    void end_array()
+    {
+        json_value v(MOVE(stack.back().array));
+        stack.pop_back();
+        add(MOVE(v));
+    }
+
+    void value(json_null x) { add(json_value(x)); }
+    void value(bool x) { add(json_value(x)); }
+    void value(json_integer x) { add(json_value(x)); }
+    void value(json_float x) { add(json_value(x)); }
+    void value(string_span s) { add(json_value(json_string(s.begin(), s.end(), atoms->allocator()))); }
+
+    // A value built some other way, e.g. a string decoded in place.
+    // Add it to the innermost open container; if there is none, it is
+    // the whole document.
+    void add(BOOST_RV_REF(json_value) v)
+    {
+        if (stack.empty())
+        {
+            root = MOVE(v);
+            complete = true;
+        }
+        else if (stack.back().is_object)
+        {
+            stack.back().members.emplace_back(MOVE(stack.back().key), MOVE(v));
+        }
+        else
+        {
+            stack.back().array.push_back(MOVE(v));
+        }
     }
+
+    // Containers open, and whether the innermost is an object
+    std::size_t depth() const { return stack.size(); }
+    bool in_object() const { return stack.back().is_object; }
+
+    arena_allocator<char> allocator() const { return atoms->allocator(); }
+
+    // The finished document
+    json_value& result()
+    {
+        assert(complete);
+        return root;
+    }
+
+ private:
+    struct frame
+    {
+        frame(bool is_object, arena_allocator<char> alloc)
+          : is_object(is_object), array(alloc), members(alloc)
+        {}
+
+        bool is_object;
+        json_array array;
+        json_object::sequence_type members;
+        json_key key;           // of the member being built
+    };
+
+    void open(bool is_object)
+    {
+        if (stack.size() == max_depth)
+            throw json_depth_error(max_depth);
+        stack.emplace_back(is_object, atoms->allocator());
+    }
+
+    json_atom_table* atoms;
+    std::size_t max_depth;
+    std::size_t hash_threshold;
+    boost::container::vector<frame> stack;
+    json_value root;
+    bool complete;
+};
+
+// The parser works over any iterator yielding token spans:
+// token_iterator, or indexed_token_iterator after a structural_index
+// pass.  It checks the tokens' order and hands them to a
+// json_tree_builder as events.
+class json_parser : boost::noncopyable
+{
+ public:
+    static std::size_t const default_max_depth = json_tree_builder::default_max_depth;
+
+    explicit json_parser(std::size_t max_depth = default_max_depth,
+                         std::size_t hash_threshold = json_object::default_hash_threshold)
+      : builder(max_depth, hash_threshold)
+    {}
+
+    template <class TokenIterator>
+    json_value parse(TokenIterator& tokens, json_atom_table& atoms)
+    {
+        builder.reset(atoms);
+        try
+        {
+            parse_value(tokens);
+        }
+        catch(...)
+        {
+            builder.clear();
+            throw;
+        }
+        json_value result(MOVE(builder.result()));
+        builder.clear();
+        return MOVE(result);
+    }
+
+ private:
+    template <class TokenIterator>
+    void parse_value(TokenIterator& tokens)
+    {
+        for (;;)
+        {
+            LOG("parse_json_value: " << first_token_text(tokens));
+
+            // Add a scalar or an empty container to the innermost open
+            // container, or open a container and go on to its first value
+            char const c = next_token_char(tokens);
+            switch (c)
+            {
+            case '[':
+            case '{':
+            {
+                bool const is_object = c == '{';
+                if (is_object)
+                    builder.start_object();
+                else
+                    builder.start_array();
+                ++tokens;
+                if (next_token_char(tokens) == (is_object ? '}' : ']'))
+                {
+                    ++tokens;
+                    close();
+                    break;
+                }
+                if (is_object)
+                    parse_key(tokens);
+                continue;
+            }
+            case 'n':
+                ++tokens;
+                builder.value(json_null());
+                break;
+            case 't':
+                ++tokens;
+                builder.value(true);
+                break;
+            case 'f':
+                ++tokens;
+                builder.value(false);
+                break;
+            case '"':
+                builder.add(json_value(parse_json_string(tokens, builder.allocator())));
+                break;
+            case '-':
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+                builder.add(parse_json_number(tokens));
+                break;
+            default:
+                throw std::invalid_argument("unexpected JSON token: " + first_token_text(tokens));
+            }
+
+            // Close each container whose last value that was
+            for (;;)
+            {
+                if (builder.depth() == 0)
+                    return;
+
+                if (next_token_char(tokens) == ',')
+                {
+                    ++tokens;
+                    if (builder.in_object())
+                        parse_key(tokens);
+                    break;
+                }
+
+                parse_literal(builder.in_object() ? "}" : "]", tokens);
+                close();
+            }
+        }
+    }
+
+    void close()
+    {
+        if (builder.in_object())
+            builder.end_object();
+        else
+            builder.end_array();
+    }
+
+    template <class TokenIterator>
+    void parse_key(TokenIterator& tokens)
+    {
+        LOG("parse_json_object key: " << first_token_text(tokens));
+        if (next_token_char(tokens) != '"')
+            throw std::invalid_argument("expected a JSON object key, found " + first_token_text(tokens));
+        builder.key(decode_json_string(*tokens++, scratch));
+        parse_literal(":", tokens);
+    }
+
+    json_tree_builder builder;
+    std::string scratch;        // for keys with escapes
+};
+
+template <class TokenIterator>
+inline json_value parse_json_value(TokenIterator& tokens, json_atom_table& atoms)
+{
+    json_parser parser;
+    return parser.parse(tokens, atoms);
+}
+
+// Parse one document, sharing keys only within it.  To share keys
+// across many documents, pass them all the same json_atom_table.
+template <class TokenIterator>
+inline json_value parse_json_value(TokenIterator& tokens)
+{
+    json_atom_table atoms;
+    return parse_json_value(tokens, atoms);
 }
 
+// A parsed document whose whole tree, keys included, lives in one
+// arena: the parse makes a few large allocations instead of one per
+// string and container, and nothing in the tree refers outside the
+// arena, so it is released all at once without visiting the tree.
+// Copies of the tree, or of any part of it, go to the heap.
+class json_document : boost::noncopyable
+{
+ public:
+    template <class TokenIterator>
+    explicit json_document(
+        TokenIterator tokens, std::size_t max_depth = json_parser::default_max_depth,
+        std::size_t hash_threshold = json_object::default_hash_threshold)
+      : atoms(&memory)
+    {
+        json_parser parser(max_depth, hash_threshold);
+        new (storage.address()) json_value(parser.parse(tokens, atoms));
+    }
+
+    json_value const& root() const
+    {
+        return *static_cast<json_value const*>(storage.address());
+    }
+
+    // Bytes the arena has taken from the heap
+    std::size_t capacity() const { return memory.capacity(); }
+
+ private:
+    arena memory;
+    json_atom_table atoms;
+    boost::aligned_storage<sizeof(json_value), boost::alignment_of<json_value>::value> storage;
+};
+
 #ifdef BUILD_PARSE_TEST
 # include <iostream>
+# include <sstream>
+
+json_value parse_number(char const* text)
+{
+    token_iterator toks = tokens(text, text + std::strlen(text));
+    return parse_json_number(toks);
+}
+
+// Whether v is an object with a hash index
+struct is_hashed : boost::static_visitor<bool>
+{
+    template <class T>
+    bool operator()(T const&) const { return false; }
+    bool operator()(json_object const& o) const { return o.hashed(); }
+};
 
-int main()
+json_string parse_string(char const* text)
 {
-    std::string text = load_file("test.json");
-    token_iterator toks = tokens(text);
-    json_value x = parse_json_value(toks);
+    token_iterator toks = tokens(text, text + std::strlen(text));
+    return parse_json_string(toks);
+}
+
+json_float parse_float(char const* text)
+{
+    json_integer i;
+    json_float f;
+    bool const is_integer = decode_json_number(text, text + std::strlen(text), i, f);
+    assert(!is_integer);
+    return f;
+}
+
+// The decoder must agree exactly with strtold
+void check_float(char const* text)
+{
+    json_integer i;
+    json_float f;
+    assert(!decode_json_number(text, text + std::strlen(text), i, f));
+    assert(f == std::strtold(text, 0));
+}
+
+// Correctly rounded reads, without rounding twice
+inline float read_back(char const* text, float) { return std::strtof(text, 0); }
+inline double read_back(char const* text, double) { return std::strtod(text, 0); }
+inline long double read_back(char const* text, long double) { return std::strtold(text, 0); }
+
+// shortest_float::format(x) reads back as x, and nothing shorter does
+template <class Float>
+std::string check_shortest(Float x)
+{
+    char text[shortest_float::max_length];
+    std::string const s(text, shortest_float::format(x, text));
+    json_integer i;
+    json_float f;
+    assert(!decode_json_number(s.data(), s.data() + s.size(), i, f));
+    assert(sizeof(Float) < sizeof(json_float) || f == x);
+    assert(read_back(s.c_str(), x) == x && std::signbit(read_back(s.c_str(), x)) == std::signbit(x));
+
+    std::string significant;
+    for (std::size_t p = 0; p < s.size() && s[p] != 'e'; ++p)
+    {
+        if (unsigned(s[p] - '0') < 10 && (s[p] != '0' || !significant.empty()))
+            significant += s[p];
+    }
+    significant.erase(significant.find_last_not_of('0') + 1);
+    if (significant.size() > 1)
+    {
+        char shorter[64];
+        std::snprintf(shorter, sizeof(shorter), "%.*Le", int(significant.size()) - 2, (long double)x);
+        assert(read_back(shorter, x) != x);
+    }
+    return s;
+}
+
+int main(int const argc, char const* argv[])
+{
+    // "./parse --index file" walks a structural_index instead
+    bool const indexed = argc > 1 && std::string(argv[1]) == "--index";
+    file_source text(argc > 1 + indexed ? argv[1 + indexed] : "test.json");
+
+    json_value x;
+    if (indexed)
+    {
+        structural_index idx(text.begin(), text.end());
+        indexed_token_iterator toks = tokens(idx);
+        x = parse_json_value(toks);
+    }
+    else
+    {
+        token_iterator toks = tokens(text);
+        x = parse_json_value(toks);
+    }
     std::cout << x << std::endl;
+
+    // What json_writer writes parses back to the same tree
+    for (int f = json_writer::compact; f <= json_writer::pretty; ++f)
+    {
+        json_writer::format const layout = json_writer::format(f);
+        json_writer w(layout);
+        w.write(x);
+        token_iterator toks = tokens(w.data(), w.data() + w.size());
+        assert(parse_json_value(toks) == x);
+    }
+
+    assert(parse_number("0") == json_value(0));
+    assert(parse_number("-0") == json_value(0));
+    assert(parse_number("42") == json_value(42));
+    assert(parse_number("1e5") == json_value(json_float(100000)));
+    assert(parse_number("-2.5E-1") == json_value(json_float(-0.25)));
+    assert(parse_number("9223372036854775807") == json_value(std::numeric_limits<json_integer>::max()));
+    assert(parse_number("-9223372036854775808") == json_value(std::numeric_limits<json_integer>::min()));
+    assert(parse_number("9223372036854775808") == json_value(json_float(9223372036854775808.0L)));
+
+    char const* const floats[] = {
+        "0.1", "3.141592653589793238462643383279", "1e-400", "-1.7976931348623157e308",
+        "2.2250738585072014e-308", "123456789012345678901234567890", "0.000000000000000000001",
+        "1.18973149535723176502e+4932", "7.0e-10", "100000000000000000000000000000e-29"
+    };
+    BOOST_FOREACH(char const* f, floats)
+    {
+        check_float(f);
+        json_integer i;
+        json_float x;
+        decode_json_number(f, f + std::strlen(f), i, x);
+        check_shortest(x);
+    }
+
+    // Shortest round-trip output
+    assert(check_shortest(json_float(0)) == "0.0" && check_shortest(-json_float(0)) == "-0.0");
+    assert(check_shortest(parse_float("0.1")) == "0.1");
+    assert(check_shortest(parse_float("-2.5e-1")) == "-0.25");
+    assert(check_shortest(parse_float("1e5")) == "100000.0");
+    assert(check_shortest(parse_float("1e20")) == "100000000000000000000.0");
+    assert(check_shortest(parse_float("1e21")) == "1e21");
+    assert(check_shortest(parse_float("123.456e-10")) == "1.23456e-8");
+    assert(check_shortest(parse_float("0.000001")) == "0.000001");
+    assert(check_shortest(parse_float("3.141592653589793238462643383279")) == "3.1415926535897932385");
+    assert(check_shortest(json_float(0.1)) == "0.10000000000000000555");
+    assert(check_shortest(0.1) == "0.1" && check_shortest(0.1f) == "0.1");
+    check_shortest(std::numeric_limits<json_float>::max());
+    check_shortest(std::numeric_limits<json_float>::min());
+    check_shortest(std::numeric_limits<json_float>::denorm_min());
+    check_shortest(std::numeric_limits<double>::denorm_min());
+    check_shortest(std::numeric_limits<double>::max());
+
+    // Random bit patterns, including powers of two and subnormals
+    boost::uint64_t seed = 42;
+    for (int n = 0; n < 2000; ++n)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        int const e = int(seed >> 40) % 32000 - 16000 - (n % 10 == 0) * 400;
+        boost::uint64_t const m = n % 7 == 0 ? boost::uint64_t(1) << 63 : seed | boost::uint64_t(1) << 63;
+        check_shortest(std::ldexp(json_float(m), e - 63));
+        check_shortest(std::ldexp(double(m >> 11), e % 1000 - 100));
+    }
+
+    assert(parse_string("\"plain\"") == "plain");
+    assert(parse_string("\"\"") == "");
+    assert(parse_string("\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\"") == "a\"b\\c/d\b\f\n\r\t");
+    assert(parse_string("\"\\u0041\\u00e9\\u20AC\\ud834\\udd1e!\"")
+           == "A\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e!");
+    assert(parse_string("\"\\ud834x\\udd1e\"") == "\xef\xbf\xbdx\xef\xbf\xbd");
+    assert(parse_string("\"a long run of plain text before \\n and after\"")
+           == "a long run of plain text before \n and after");
+
+    // Strings without escapes are borrowed, not copied
+    std::string scratch;
+    char const plain[] = "\"borrowed\"";
+    string_span const view = decode_json_string(*tokens(plain, plain + 10), scratch);
+    assert(view.begin() == plain + 1 && view.size() == 8 && scratch.empty());
+    char const escaped[] = "\"x\\ty\"";
+    assert(decode_json_string(*tokens(escaped, escaped + 7), scratch) == std::string("x\ty"));
+
+    // A document in an arena equals the same tree on the heap, and a
+    // copy of it outlives the arena
+    json_value copy;
+    {
+        token_iterator toks = tokens(text);
+        json_document const doc(toks);
+        assert(doc.root() == x && doc.capacity() > 0);
+        copy = doc.root();
+    }
+    assert(copy == x);
+    {
+        char const scalar[] = "\"a string too long to be stored inline\"";
+        json_document const doc(tokens(scalar, scalar + sizeof(scalar) - 1));
+        assert(doc.root() == json_value("a string too long to be stored inline"));
+    }
+
+    // Unsorted members and duplicate keys: the last duplicate wins
+    char const members[] = "{\"b\": 1, \"a\": 2, \"c\": 3, \"a\": 4, \"b\": 5, \"a\": 6}";
+    token_iterator member_toks = tokens(members, members + sizeof(members) - 1);
+    json_object expected;
+    expected["a"] = 6;
+    expected["b"] = 5;
+    expected["c"] = 3;
+    assert(parse_json_value(member_toks) == json_value(expected));
+
+    // Enough members for std::stable_sort, or for a hash index
+    std::ostringstream many;
+    json_object many_expected;
+    many << "{";
+    for (int i = 0; i < 100; ++i)
+    {
+        int const key = i * 37 % 41;
+        many << (i ? ", " : "") << "\"k" << key << "\": " << i;
+        std::ostringstream k;
+        k << "k" << key;
+        many_expected[k.str().c_str()] = i;
+    }
+    many << "}";
+    std::string const many_text = many.str();
+    member_toks = tokens(many_text);
+    json_atom_table many_atoms;
+    json_value const many_value = json_parser(json_parser::default_max_depth, std::size_t(-1))
+        .parse(member_toks, many_atoms);
+    assert(many_value == json_value(many_expected));
+    assert(!boost::apply_visitor(is_hashed(), many_value));
+    member_toks = tokens(many_text);
+    json_value const hashed_value = parse_json_value(member_toks);
+    assert(boost::apply_visitor(is_hashed(), hashed_value) && hashed_value == many_value);
+
+    // Hashed objects print their members in input order, each where
+    // its key first appeared, with its last value
+    member_toks = tokens(members, members + sizeof(members) - 1);
+    std::ostringstream in_order;
+    in_order << json_parser(json_parser::default_max_depth, 0).parse(member_toks, many_atoms);
+    assert(in_order.str() == "{\"b\":5,\"a\":6,\"c\":3}");
+    {
+        json_document const doc(tokens(many_text), json_parser::default_max_depth, 0);
+        assert(boost::apply_visitor(is_hashed(), doc.root()) && doc.root() == many_value);
+    }
+
+    // Nesting is limited by the parser's max_depth, not the call stack
+    json_atom_table nested_atoms;
+    json_value nested = json_array();
+    for (int i = 0; i < 3; ++i)
+    {
+        json_array a;
+        a.push_back(MOVE(nested));
+        json_object o;
+        o["k"] = json_value(MOVE(a));
+        nested = json_value(MOVE(o));
+    }
+    char const three[] = "{\"k\": [{\"k\": [{\"k\": [[]]}]}]}";
+    token_iterator nested_toks = tokens(three, three + sizeof(three) - 1);
+    assert(json_parser(7).parse(nested_toks, nested_atoms) == nested);
+    try
+    {
+        nested_toks = tokens(three, three + sizeof(three) - 1);
+        json_parser(6).parse(nested_toks, nested_atoms);
+        assert(!"excess depth not detected");
+    }
+    catch(json_depth_error const& e)
+    {
+        assert(e.max_depth == 6);
+    }
+
+    std::size_t const depth = 300000;
+    std::string const deep = std::string(depth, '[') + std::string(depth, ']');
+    {
+        json_document const doc(tokens(deep), depth);
+    }
+    try
+    {
+        json_document const doc(tokens(deep), depth - 1);
+        assert(!"excess depth not detected");
+    }
+    catch(json_depth_error const&) {}
+
+    // Repeated keys share storage, across documents too
+    char const repeated[] = "[{\"id\": 1, \"n\\u0061me\": \"x\"}, {\"name\": \"y\", \"id\": 2}]";
+    json_atom_table atoms;
+    token_iterator toks = tokens(repeated, repeated + sizeof(repeated) - 1);
+    json_value const records = parse_json_value(toks, atoms);
+    assert(atoms.size() == 2);
+    toks = tokens(repeated, repeated + sizeof(repeated) - 1);
+    assert(parse_json_value(toks, atoms) == records && atoms.size() == 2);
+    std::cout << records << std::endl;
+
+    // Truncated or misplaced tokens throw rather than reading past the
+    // last token, or being dropped
+    char const* const malformed[] = {
+        "", "[", "[1,", "{", "{\"a\"", "{\"a\":", "{\"a\":1,", "[[1]",
+        "{1:2}", "{\"a\":1,}", "{]", "[1 2]", "{\"a\":1 \"b\":2}", "[1}", "{\"a\":1]",
+        "{\"a\" 1}", "{\"a\",1}", "[,1]", "[1,,2]", "{\"a\"::1}", ":", "]"
+    };
+    BOOST_FOREACH(char const* text, malformed)
+    {
+        try
+        {
+            toks = tokens(text, text + std::strlen(text));
+            parse_json_value(toks);
+            assert(!"malformed input accepted");
+        }
+        catch(std::invalid_argument const&) {}
+    }
+
+    try
+    {
+        parse_number("1e99999");
+        assert(!"overflow not detected");
+    }
+    catch(std::range_error const&) {}
 }
 #endif 
@@ -0,0 +1,147 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares json_parser's explicit stack with the recursive descent
+// parse_json_value() used to do, over an array of copies of a file and
+// over deeply nested arrays.
+//
+//   ./parser_bench [file [size]]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+
+// The old parser, one call per nesting level
+namespace recursive
+{
+  template <class TokenIterator>
+  json_value parse_value(TokenIterator& tokens, json_atom_table& atoms);
+
+  template <class TokenIterator>
+  json_value parse_array(TokenIterator& tokens, json_atom_table& atoms)
+  {
+      parse_literal("[", tokens);
+      json_array a(atoms.allocator());
+      while (*tokens->first != ']')
+      {
+          if (!a.empty())
+              parse_literal(",", tokens);
+          a.push_back(parse_value(tokens, atoms));
+      }
+      parse_literal("]", tokens);
+      return MOVE(a);
+  }
+
+  template <class TokenIterator>
+  json_value parse_object(TokenIterator& tokens, json_atom_table& atoms)
+  {
+      parse_literal("{", tokens);
+      json_object::sequence_type members(atoms.allocator());
+      std::string scratch;
+      while (*tokens->first != '}')
+      {
+          if (!members.empty())
+              parse_literal(",", tokens);
+          string_span const s = decode_json_string(*tokens++, scratch);
+          json_key k = atoms.intern(s.begin(), s.end());
+          parse_literal(":", tokens);
+          members.emplace_back(MOVE(k), parse_value(tokens, atoms));
+      }
+      parse_literal("}", tokens);
+      return make_json_object(members);
+  }
+
+  template <class TokenIterator>
+  json_value parse_value(TokenIterator& tokens, json_atom_table& atoms)
+  {
+      switch (*tokens->first)
+      {
+      case '[':
+          return parse_array(tokens, atoms);
+      case '{':
+          return parse_object(tokens, atoms);
+      case 'n':
+          ++tokens;
+          return json_null();
+      case 't':
+          ++tokens;
+          return true;
+      case 'f':
+          ++tokens;
+          return false;
+      case '"':
+          return parse_json_string(tokens, atoms.allocator());
+      default:
+          return parse_json_number(tokens);
+      }
+  }
+}
+
+// The result is destroyed after timing stops
+struct parse_with_recursion
+{
+    parse_with_recursion(std::string const& text, json_value& result)
+      : text(text), result(result) {}
+
+    void operator()() const
+    {
+        json_atom_table atoms;
+        token_iterator toks = tokens(text);
+        result = recursive::parse_value(toks, atoms);
+    }
+
+    std::string const& text;
+    json_value& result;
+};
+
+struct parse_with_stack
+{
+    parse_with_stack(std::string const& text, json_value& result)
+      : text(text), result(result) {}
+
+    void operator()() const
+    {
+        json_atom_table atoms;
+        token_iterator toks = tokens(text);
+        result = json_parser().parse(toks, atoms);
+    }
+
+    std::string const& text;
+    json_value& result;
+};
+
+// Best of several runs
+template <class Parse>
+double best_time(std::string const& text)
+{
+    double best = 1e30;
+    for (int i = 0; i < 5; ++i)
+    {
+        json_value result;
+        best = std::min(best, time_it(Parse(text, result)));
+    }
+    return best;
+}
+
+void compare(char const* what, std::string const& text)
+{
+    std::printf("%s\n", what);
+    report("  recursive", best_time<parse_with_recursion>(text), text.size());
+    report("  explicit stack", best_time<parse_with_stack>(text), text.size());
+}
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::size_t const size = parse_size(argc > 2 ? argv[2] : "16M");
+
+    compare("copies of the file", scale(input.begin(), input.end(), size));
+
+    // Nesting the recursive parser survives, many times over
+    std::string nested;
+    while (nested.size() < size)
+        nested += std::string(1000, '[') + "1" + std::string(1000, ']') + ",";
+    nested = "[" + nested + "0]";
+    compare("arrays nested 1000 deep", nested);
+}
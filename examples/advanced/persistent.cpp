@@ -0,0 +1,869 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// shared.cpp's json_value shares its json_store among copies, so
+// changing one copy changes them all, and erasure.cpp's clones the
+// whole tree on every copy.  This one is persistent: copies share
+// nodes, and are O(1), but no node that's shared is ever changed.
+// Writing through at() first copies the node, if it's shared, so
+// changing something deep in a document copies only the nodes on the
+// path down to it, each of which still shares its other children.
+// with() does the same to a copy, leaving the original as it was.
+//
+// Since a shared node never changes, it can keep its hash, computed
+// the first time it's asked for, and == uses it to tell most unequal
+// values apart without looking inside them.  A json_cons_table merges
+// equal subtrees, so that repeated fragments are stored once.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_PERSISTENT_TEST
+#endif
+#include <boost/move/move.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/vector.hpp>
+#include <boost/container/string.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/foreach.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/io/ios_state.hpp>
+
+#include <boost/noncopyable.hpp>
+#include <boost/operators.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "json_escape.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <ostream>
+
+bool logging = false;
+
+#ifndef NDEBUG
+# include <iostream>
+# define LOG(x) do { if (logging) std::cout << x << std::endl; } while(0)
+#else
+# define LOG(x)
+#endif
+
+struct json_null {};
+
+std::ostream& operator<<(std::ostream& s, json_null const& x)
+{
+    return s << "null";
+}
+
+typedef long double json_float;
+
+#ifndef BOOST_NO_INT64_T
+typedef boost::int64_t json_integer;
+#else
+typedef boost::int32_t json_integer;
+#endif 
+
+struct json_string : boost::container::string
+{
+    typedef boost::container::string rep_t;
+    
+    json_string(char const* p) : rep_t(p) {}
+
+#ifndef __GNUC__ // Workaround for http://gcc.gnu.org/bugzilla/show_bug.cgi?id=55206
+    json_string(rep_t rhs) { rhs.swap(*this); }
+#endif 
+    json_string() {}
+    
+    json_string(json_string const& rhs)
+        : rep_t(rhs)
+    {
+        LOG("json_string copy");
+    }
+
+    template <class Iterator>
+    json_string(Iterator begin, Iterator end)
+        : rep_t(begin, end)
+    {
+    }
+
+    json_string& operator=(BOOST_COPY_ASSIGN_REF(json_string) rhs) // Copy assignment
+    {
+        LOG("json_string copy assign");
+        rep_t::operator=(rhs);
+        return *this;
+    }
+
+    // Move constructor
+    json_string(BOOST_RV_REF(json_string) rhs)            //Move constructor
+        : rep_t(boost::move(rhs))
+    {
+        LOG("json_string move");
+    }
+
+    json_string& operator=(BOOST_RV_REF(json_string) rhs) //Move assignment
+    {
+        LOG("json_string move assign");
+        rep_t::operator=(boost::move(rhs));
+        return *this;
+    }
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(json_string)
+};
+
+inline std::ostream& operator<<(std::ostream& os, json_string const& s)
+{
+    std::string out;
+    json_escape::append_quoted(out, s.data(), s.data() + s.size());
+    return os << out;
+}
+
+
+struct json_value;
+typedef boost::container::vector<json_value> json_array;
+typedef boost::container::flat_map<json_string, json_value> json_object;
+
+struct json_node;
+
+struct json_value
+  : boost::totally_ordered<json_value>
+{
+    // What a json_value holds, in the order that < sorts them
+    enum kind { null, string, boolean, integer, floating, array, object };
+
+    json_value() : node(0) {}
+
+    template <class T>
+    json_value(T x)
+      : node(acquire(make_node(x, boost::is_integral<T>(), boost::is_floating_point<T>())))
+    {}
+
+    json_value(char const* s);
+
+    // Copies share a node, until one of them is written
+    json_value(json_value const& rhs)
+      : node(acquire(rhs.node))
+    {
+        LOG("json_value copy");
+    }
+
+    json_value(BOOST_RV_REF(json_value) rhs)
+      : node(rhs.node)
+    {
+        rhs.node = 0;
+    }
+
+    ~json_value() { release(node); }
+
+    json_value& operator=(BOOST_COPY_ASSIGN_REF(json_value) rhs)
+    {
+        json_value(rhs).swap(*this);
+        return *this;
+    }
+
+    json_value& operator=(BOOST_RV_REF(json_value) rhs)
+    {
+        json_value(boost::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    template <class T>
+    json_value& operator=(T x)
+    {
+        json_value(boost::move(x)).swap(*this);
+        return *this;
+    }
+
+    void swap(json_value& rhs)
+    {
+        std::swap(node, rhs.node);
+    }
+
+    friend void swap(json_value& lhs, json_value& rhs)
+    {
+        lhs.swap(rhs);
+    }
+
+    kind type() const;
+
+    // True if this and v are one node, as copies are until written
+    bool shares(json_value const& v) const { return node == v.node; }
+
+    // A hash of the whole tree, consistent with ==.  Each node keeps
+    // its own, so only nodes written since the last call are visited.
+    boost::uint64_t hash() const;
+
+    // The T held, which must be of type()
+    template <class T>
+    T const& get() const;
+
+    // An element of an array, or a member of an object, which must
+    // be there
+    json_value const& operator[](std::size_t i) const
+    {
+        return get<json_array>()[i];
+    }
+
+    json_value const& operator[](json_string const& key) const
+    {
+        json_value const* const member = find(key);
+        assert(member);
+        return *member;
+    }
+
+    // A member of an object, or 0
+    json_value const* find(json_string const& key) const
+    {
+        json_object const& o = get<json_object>();
+        json_object::const_iterator const m = o.find(key);
+        return m == o.end() ? 0 : &m->second;
+    }
+
+    // The T held, to be written: if the node is shared, this value gets
+    // a copy of it first, which shares its children.  A null value
+    // becomes an empty T.  Copying this value again makes the result
+    // shared, and hashing it, or anything holding it, keeps a hash that
+    // writing wouldn't change, so it shouldn't be written after either.
+    template <class T>
+    T& edit();
+
+    // An element of an array, or a member of an object, added if need
+    // be, to be written
+    json_value& at(std::size_t i)
+    {
+        return edit<json_array>()[i];
+    }
+
+    json_value& at(json_string const& key)
+    {
+        return edit<json_object>()[key];
+    }
+
+    // A copy with one element or member replaced, leaving this as it was
+    json_value with(std::size_t i, json_value v) const
+    {
+        json_value r(*this);
+        r.at(i) = boost::move(v);
+        return r;
+    }
+
+    json_value with(json_string const& key, json_value v) const
+    {
+        json_value r(*this);
+        r.at(key) = boost::move(v);
+        return r;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, json_value const& v);
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(json_value)
+
+    template <class T>
+    static json_node* make_node(T x, boost::true_type, boost::false_type);
+    static json_node* make_node(bool x, boost::true_type, boost::false_type);
+    template <class T>
+    static json_node* make_node(T x, boost::false_type, boost::true_type);
+    template <class T>
+    static json_node* make_node(T& x, boost::false_type, boost::false_type);
+    static json_node* make_node(json_null, boost::false_type, boost::false_type) { return 0; }
+
+    static json_node* acquire(json_node* n);
+    static void release(json_node* n);
+
+    json_node* node;
+};
+
+template <class T> struct json_kind;
+template <> struct json_kind<json_string> { static json_value::kind const value = json_value::string; };
+template <> struct json_kind<bool> { static json_value::kind const value = json_value::boolean; };
+template <> struct json_kind<json_integer> { static json_value::kind const value = json_value::integer; };
+template <> struct json_kind<json_float> { static json_value::kind const value = json_value::floating; };
+template <> struct json_kind<json_array> { static json_value::kind const value = json_value::array; };
+template <> struct json_kind<json_object> { static json_value::kind const value = json_value::object; };
+
+// Its children are json_values, so copying a node copies none of them
+struct json_node : boost::noncopyable
+{
+    explicit json_node(json_value::kind type) : type(type), refs(0), hash(0) {}
+    virtual ~json_node() {}
+
+    virtual json_node* clone() const = 0;
+    virtual void print(std::ostream&) const = 0;
+    virtual boost::uint64_t compute_hash() const = 0;
+
+    json_value::kind const type;
+    mutable boost::detail::atomic_count refs;
+
+    // compute_hash(), or 0 until it's first needed, or since the node
+    // was last written.  Threads sharing a node may each compute it,
+    // but they all store the same value, and atomically, so relaxed
+    // order is enough.
+    mutable boost::atomic<boost::uint64_t> hash;
+};
+
+// boost::hash_combine's mix, on 64 bits
+inline boost::uint64_t combine_hash(boost::uint64_t seed, boost::uint64_t h)
+{
+    return seed ^ (h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+// Seeded with the kind, so that, say, true and 1 hash differently
+template <class T>
+inline boost::uint64_t hash_of(T const& x)
+{
+    return combine_hash(json_kind<T>::value, boost::hash_value(x));
+}
+
+inline boost::uint64_t hash_of(json_string const& s)
+{
+    return combine_hash(json_value::string, boost::hash_range(s.begin(), s.end()));
+}
+
+inline boost::uint64_t hash_of(json_array const& a)
+{
+    boost::uint64_t h = json_value::array;
+    BOOST_FOREACH(json_value const& v, a)
+        h = combine_hash(h, v.hash());
+    return h;
+}
+
+inline boost::uint64_t hash_of(json_object const& o)
+{
+    boost::uint64_t h = json_value::object;
+    BOOST_FOREACH(json_object::value_type const& m, o)
+        h = combine_hash(combine_hash(h, hash_of(m.first)), m.second.hash());
+    return h;
+}
+
+template <class T>
+struct json_store : json_node
+{
+    explicit json_store(T const& x)
+      : json_node(json_kind<T>::value), value(x)
+    {}
+
+    explicit json_store(BOOST_RV_REF(T) x)
+      : json_node(json_kind<T>::value), value(boost::move(x))
+    {}
+
+    virtual json_node* clone() const
+    {
+        return new json_store(value);
+    }
+
+    virtual void print(std::ostream& os) const
+    {
+        boost::io::ios_flags_saver ifs( os );
+        os << std::boolalpha << value;
+    }
+
+    virtual boost::uint64_t compute_hash() const
+    {
+        return hash_of(value);
+    }
+
+    T value;
+};
+
+inline json_value::json_value(char const* s)
+  : node(acquire(new json_store<json_string>(json_string(s))))
+{}
+
+inline json_value::kind json_value::type() const
+{
+    return node ? node->type : null;
+}
+
+template <class T>
+inline T const& json_value::get() const
+{
+    assert(type() == json_kind<T>::value);
+    return static_cast<json_store<T> const*>(node)->value;
+}
+
+template <class T>
+inline T& json_value::edit()
+{
+    if (!node)
+        node = acquire(new json_store<T>(T()));
+    assert(type() == json_kind<T>::value);
+    if (node->refs > 1)
+    {
+        json_node* const mine = acquire(node->clone());
+        release(node);
+        node = mine;
+    }
+    node->hash.store(0, boost::memory_order_relaxed);
+    return static_cast<json_store<T>*>(node)->value;
+}
+
+inline boost::uint64_t json_value::hash() const
+{
+    if (!node)
+        return json_value::null;
+    boost::uint64_t h = node->hash.load(boost::memory_order_relaxed);
+    if (!h)
+    {
+        h = node->compute_hash();
+        if (!h)
+            h = 1;
+        node->hash.store(h, boost::memory_order_relaxed);
+    }
+    return h;
+}
+
+template <class T>
+inline json_node* json_value::make_node(T x, boost::true_type, boost::false_type)
+{
+    return new json_store<json_integer>(x);
+}
+
+inline json_node* json_value::make_node(bool x, boost::true_type, boost::false_type)
+{
+    return new json_store<bool>(x);
+}
+
+template <class T>
+inline json_node* json_value::make_node(T x, boost::false_type, boost::true_type)
+{
+    return new json_store<json_float>(x);
+}
+
+template <class T>
+inline json_node* json_value::make_node(T& x, boost::false_type, boost::false_type)
+{
+    return new json_store<T>(boost::move(x));
+}
+
+inline json_node* json_value::acquire(json_node* n)
+{
+    if (n)
+        ++n->refs;
+    return n;
+}
+
+inline void json_value::release(json_node* n)
+{
+    if (n && --n->refs == 0)
+        delete n;
+}
+
+inline std::ostream& operator<<(std::ostream& s, json_array const& a)
+{
+    char const* separator = " ";
+    s << "[";
+    BOOST_FOREACH(json_value const& v, a)
+    {
+        s << separator << v;
+        separator = ", ";
+    }
+    s << " ]";
+    return s;
+}
+
+inline std::ostream& operator<<(std::ostream& s, json_object const& o)
+{
+    char const* separator = " ";
+    s << "{";
+    BOOST_FOREACH(json_object::value_type const& v, o)
+    {
+        s << separator << v.first << " : " << v.second;
+        separator = ", ";
+    }
+    s << " }";
+    return s;
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_value const& v)
+{
+    if (v.node)
+        v.node->print(os);
+    else
+        os << json_null();
+    return os;
+}
+
+// ------------ comparison --------------
+
+// Negative, zero or positive as x sorts before, with or after y.  Shared
+// nodes are equal without looking inside, so comparing two versions of
+// a document only visits the nodes along the paths where they differ.
+inline int compare(json_value const& x, json_value const& y)
+{
+    if (x.shares(y))
+        return 0;
+    json_value::kind const k = x.type();
+    if (k != y.type())
+        return k < y.type() ? -1 : 1;
+
+    switch (k)
+    {
+    case json_value::string:
+    {
+        int const c = x.get<json_string>().compare(y.get<json_string>());
+        return c < 0 ? -1 : c > 0;
+    }
+    case json_value::boolean:
+        return int(x.get<bool>()) - int(y.get<bool>());
+    case json_value::integer:
+        return x.get<json_integer>() < y.get<json_integer>()
+            ? -1 : x.get<json_integer>() > y.get<json_integer>();
+    case json_value::floating:
+        return x.get<json_float>() < y.get<json_float>()
+            ? -1 : x.get<json_float>() > y.get<json_float>();
+    case json_value::array:
+    {
+        json_array const& a = x.get<json_array>();
+        json_array const& b = y.get<json_array>();
+        for (std::size_t i = 0; i < a.size() && i < b.size(); ++i)
+        {
+            if (int const c = compare(a[i], b[i]))
+                return c;
+        }
+        return a.size() < b.size() ? -1 : a.size() > b.size();
+    }
+    case json_value::object:
+    {
+        json_object const& a = x.get<json_object>();
+        json_object const& b = y.get<json_object>();
+        json_object::const_iterator i = a.begin(), j = b.begin();
+        for (; i != a.end() && j != b.end(); ++i, ++j)
+        {
+            if (int const c = i->first.compare(j->first))
+                return c < 0 ? -1 : 1;
+            if (int const c = compare(i->second, j->second))
+                return c;
+        }
+        return a.size() < b.size() ? -1 : a.size() > b.size();
+    }
+    default:
+        return 0;
+    }
+}
+
+// Values whose hashes differ are unequal.  The first comparison of a
+// tree hashes all of it, but the nodes keep their hashes for the next.
+// Unlike compare(), which puts them in order, NaNs are unequal, even
+// to themselves, at any depth, except inside a container both sides
+// share: that is equal without being looked into.
+inline bool operator==(json_value const& x, json_value const& y)
+{
+    if (x.type() == json_value::floating && y.type() == json_value::floating)
+        return x.get<json_float>() == y.get<json_float>();
+    if (x.shares(y))
+        return true;
+    if (x.type() != y.type() || x.hash() != y.hash())
+        return false;
+
+    switch (x.type())
+    {
+    case json_value::array:
+    {
+        json_array const& a = x.get<json_array>();
+        json_array const& b = y.get<json_array>();
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+    }
+    case json_value::object:
+    {
+        json_object const& a = x.get<json_object>();
+        json_object const& b = y.get<json_object>();
+        if (a.size() != b.size())
+            return false;
+        for (json_object::const_iterator i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+        {
+            if (i->first != j->first || !(i->second == j->second))
+                return false;
+        }
+        return true;
+    }
+    default:
+        return compare(x, y) == 0;
+    }
+}
+
+inline bool operator<(json_value const& x, json_value const& y)
+{
+    return compare(x, y) < 0;
+}
+
+// ------------ hash-consing --------------
+
+// Interning a value returns an equal one that shares its nodes, all the
+// way down, with those of every value interned before, so a fragment
+// repeated across documents, or within one, is stored once, and
+// interned values are equal exactly when they share a node.  Like
+// json_atom_table's atoms, interned nodes live as long as the table,
+// or as the values holding them, whichever is longer.
+class json_cons_table : boost::noncopyable
+{
+ public:
+    json_value intern(json_value const& v);
+
+    // Distinct nodes interned
+    std::size_t size() const { return nodes.size(); }
+
+ private:
+    struct hasher
+    {
+        std::size_t operator()(json_value const& v) const { return std::size_t(v.hash()); }
+    };
+
+    // Children are interned before their container, so containers are
+    // the same when their children share nodes.  compare() finds 0 and
+    // -0.0 the same, but they print differently, so they aren't.
+    struct same
+    {
+        bool operator()(json_value const& x, json_value const& y) const
+        {
+            if (x.shares(y))
+                return true;
+            if (x.type() != y.type() || x.hash() != y.hash())
+                return false;
+            switch (x.type())
+            {
+            case json_value::floating:
+            {
+                json_float const a = x.get<json_float>(), b = y.get<json_float>();
+                return a == b ? std::signbit(a) == std::signbit(b)
+                    : std::isnan(a) && std::isnan(b);
+            }
+            case json_value::array:
+            {
+                json_array const& a = x.get<json_array>();
+                json_array const& b = y.get<json_array>();
+                if (a.size() != b.size())
+                    return false;
+                for (std::size_t i = 0; i < a.size(); ++i)
+                {
+                    if (!a[i].shares(b[i]))
+                        return false;
+                }
+                return true;
+            }
+            case json_value::object:
+            {
+                json_object const& a = x.get<json_object>();
+                json_object const& b = y.get<json_object>();
+                if (a.size() != b.size())
+                    return false;
+                for (json_object::const_iterator i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+                {
+                    if (i->first != j->first || !i->second.shares(j->second))
+                        return false;
+                }
+                return true;
+            }
+            default:
+                return compare(x, y) == 0;
+            }
+        }
+    };
+
+    boost::unordered_set<json_value, hasher, same> nodes;
+};
+
+inline json_value json_cons_table::intern(json_value const& v)
+{
+    json_value r(v);
+    if (v.type() == json_value::null)
+        return r;
+
+    // Children first, so that equal containers share their elements,
+    // and comparing them is quick
+    if (v.type() == json_value::array)
+    {
+        json_array const& a = v.get<json_array>();
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            json_value const e = intern(a[i]);
+            if (!e.shares(a[i]))
+                r.at(i) = e;
+        }
+    }
+    else if (v.type() == json_value::object)
+    {
+        BOOST_FOREACH(json_object::value_type const& m, v.get<json_object>())
+        {
+            json_value const e = intern(m.second);
+            if (!e.shares(m.second))
+                r.at(m.first) = e;
+        }
+    }
+    return *nodes.insert(r).first;
+}
+
+// ------------ test driver --------------
+
+#ifdef BUILD_PERSISTENT_TEST
+# include "alloc_count.hpp"
+# include <iostream>
+# include <sstream>
+# include <limits>
+
+template <class T>
+std::string printed(T const& x)
+{
+    std::ostringstream s;
+    s << x;
+    return s.str();
+}
+
+int main()
+{
+    json_value v = json_string("foo bar");
+    std::cout << v << std::endl << std::flush;
+    json_array a;
+    a.push_back(false);
+    a.push_back(1);
+    a.push_back(42.7);
+    a.push_back("b\"a\"z");
+    std::cout << "---------------------------" << std::endl;
+    std::cout << a << std::endl;
+
+    json_object o;
+    o["foo"] = 1;
+    o["bar"] = "baz";
+    o["xxx"] = 3.14;
+    o["lick"] = a;
+    o["pork"] = true;
+    std::cout << o << std::endl;
+    assert(printed(json_value(o)) == printed(o));
+    assert(printed(json_value()) == "null" && printed(json_value(json_null())) == "null");
+
+    // Copies are O(1), however big
+    json_value doc = o;
+    std::size_t allocations = counting::allocations;
+    json_value snapshot = doc;
+    assert(counting::allocations == allocations && snapshot.shares(doc) && snapshot == doc);
+
+    // Writing a copy copies only its own node, which shares the
+    // children
+    snapshot.at("foo") = 2;
+    assert(counting::allocations == allocations + 3);   // node, members, 2
+    assert(!snapshot.shares(doc) && snapshot["lick"].shares(doc["lick"]));
+    assert(doc["foo"] == json_value(1) && snapshot["foo"] == json_value(2));
+    assert(doc < snapshot && doc != snapshot);
+
+    // Writing a value that isn't shared copies nothing
+    allocations = counting::allocations;
+    snapshot.at("foo") = json_null();
+    assert(counting::allocations == allocations && snapshot["foo"].type() == json_value::null);
+
+    // A change deep down copies the path to it, and nothing beside it
+    json_value tree;
+    tree.at("a").at("b").at("c") = 1;
+    tree.at("a").at("x") = a;
+    tree.at("y") = o;
+    allocations = counting::allocations;
+    json_value const before = tree;
+    json_value after = tree;
+    after.at("a").at("b").at("c") = 2;
+    assert(counting::allocations == allocations + 3 * 2 + 1);
+    assert(after["a"]["x"].shares(before["a"]["x"]) && after["y"].shares(before["y"]));
+    assert(!after["a"]["b"].shares(before["a"]["b"]));
+    assert(before["a"]["b"]["c"] == json_value(1) && after["a"]["b"]["c"] == json_value(2));
+    assert(tree.shares(before) && before != after);
+
+    // with() leaves the original alone
+    json_value const with = before.with("y", 3);
+    assert(with["y"] == json_value(3) && before["y"] == json_value(o) && with["a"].shares(before["a"]));
+    json_value const array = a;
+    json_value const replaced = array.with(1, "one");
+    assert(printed(replaced) == "[ false, \"one\", 42.7, \"b\\\"a\\\"z\" ]");
+    assert(printed(json_value("tab\t/\x1f")) == "\"tab\\t/\\u001f\"");
+    assert(printed(array) == printed(a));
+
+    // Ordered by kind, then by value, however deep
+    json_value deep = 1, deeper = 1;
+    for (int d = 0; d < 200; ++d)
+    {
+        json_array wrap;
+        wrap.push_back(deep);
+        deep = wrap;
+        deeper = json_value().with("child", deeper);
+    }
+    assert(deep == json_value(deep) && deeper == deeper.with("child", deeper["child"]));
+    assert(deep < deeper && !(deeper < deep));
+    json_float const inf = std::numeric_limits<json_float>::infinity();
+    json_value const nan = inf - inf;
+    assert(nan != nan && json_value(0) != json_value(0.0) && json_value(false) < json_value(0));
+    json_array two_nans(2, nan);
+    json_value const nans = two_nans;
+    assert(nans != json_value(two_nans) && nans.with(1, 1) != nans.with(1, 1));
+    assert(nans == nans && json_value().with("x", nan) != json_value().with("x", nan));
+    json_array sorted;
+    sorted.push_back(json_object());
+    sorted.push_back(2.5);
+    sorted.push_back(7);
+    sorted.push_back(json_value());
+    sorted.push_back("s");
+    sorted.push_back(true);
+    sorted.push_back(json_array());
+    std::sort(sorted.begin(), sorted.end());
+    assert(printed(sorted) == "[ null, \"s\", true, 7, 2.5, [ ], { } ]");
+
+    // Equal trees hash alike, built separately or not, and a write
+    // changes the hash of the nodes it copies
+    json_value rebuilt;
+    rebuilt.at("a").at("x") = a;
+    rebuilt.at("a").at("b").at("c") = 1;
+    rebuilt.at("y") = o;
+    assert(!rebuilt.shares(before) && rebuilt.hash() == before.hash() && rebuilt == before);
+    assert(after.hash() != before.hash() && after["a"]["x"].hash() == before["a"]["x"].hash());
+    boost::uint64_t const old_hash = rebuilt.hash();
+    rebuilt.at("a").at("b").at("c") = 2;
+    assert(rebuilt.hash() != old_hash && rebuilt.hash() == after.hash() && rebuilt == after);
+    assert(json_value(0.0).hash() == json_value(-0.0).hash() && json_value(0.0) == json_value(-0.0));
+    assert(json_value(true).hash() != json_value(1).hash());
+
+    json_value const other = rebuilt.with("z", 1);
+    assert(other != rebuilt && other.hash() != rebuilt.hash() && rebuilt != before);
+
+    // Interning merges equal subtrees, within a document and across
+    // documents
+    json_cons_table table;
+    json_array records;
+    for (int i = 0; i < 6; ++i)
+    {
+        json_value r;
+        r.at("id") = i % 2;
+        r.at("tags").edit<json_array>().push_back("x");
+        records.push_back(r);
+    }
+    json_value const interned = table.intern(records);
+    assert(interned == json_value(records) && printed(interned) == printed(records));
+    assert(interned[0].shares(interned[2]) && interned[1].shares(interned[5]));
+    assert(!interned[0].shares(interned[1]) && interned[0]["tags"].shares(interned[1]["tags"]));
+    std::size_t const distinct = table.size();
+    assert(distinct == 7);     // 0, 1, "x", ["x"], two records, the array
+
+    json_array again(records.rbegin(), records.rend());
+    json_value const reversed = table.intern(again);
+    assert(reversed[0].shares(interned[1]) && table.size() == distinct + 1);
+    allocations = counting::allocations;
+    assert(table.intern(interned).shares(interned) && counting::allocations == allocations);
+
+    // 0 and -0.0 are equal, but aren't merged
+    assert(table.intern(json_value(-0.0)).hash() == table.intern(json_value(0.0)).hash());
+    assert(printed(table.intern(json_value(-0.0))) == "-0");
+    json_array zero(1, json_value(0.0)), minus_zero(1, json_value(-0.0));
+    json_value const zeros = table.intern(zero);
+    assert(printed(table.intern(minus_zero)) == "[ -0 ]" && printed(zeros) == "[ 0 ]");
+    json_object z, mz;
+    z["z"] = zero;
+    mz["z"] = minus_zero;
+    table.intern(z);
+    assert(printed(table.intern(mz)) == "{ \"z\" : [ -0 ] }");
+}
+#endif
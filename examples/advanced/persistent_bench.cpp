@@ -0,0 +1,162 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over persistent.cpp's json_value, whose copies share
+// nodes until they're written, then a tree of about [values] values
+// changed one leaf at a time, keeping every one of [versions] versions,
+// then documents of about [values] values in all, built from a few
+// distinct records, compared and interned in a json_cons_table
+//
+//   ./persistent_bench [values] [versions]
+
+#define NO_TEST
+#define REPR_ORDERED
+#include "persistent.cpp"
+#include "repr_bench.hpp"
+#include <vector>
+
+namespace
+{
+  std::size_t const fanout = 16;
+
+  // Objects of fanout members each, depth levels deep, with integers
+  // at the leaves
+  json_value tree(std::size_t depth, json_string const keys[])
+  {
+      if (depth == 0)
+          return json_value(0);
+      json_object o;
+      for (std::size_t k = 0; k < fanout; ++k)
+          o[keys[k]] = tree(depth - 1, keys);
+      return json_value(boost::move(o));
+  }
+
+  // One of a pool of distinct records, built afresh
+  json_value record(std::size_t r, json_string const keys[])
+  {
+      json_object o;
+      o[keys[0]] = json_integer(r);
+      char const* const tag = "abcdefghijklmnopqrstuvwxyz" + r % 16;
+      o[keys[1]] = json_string(tag, tag + 8);
+      json_array a;
+      for (std::size_t i = 0; i < 4; ++i)
+          a.push_back(json_integer((r + i) % 7));
+      o[keys[2]] = boost::move(a);
+      return json_value(boost::move(o));
+  }
+
+  // Each value equal to the next, but separately built, and so the
+  // same on every pass
+  std::size_t adjacent_equal(std::vector<json_value> const& docs)
+  {
+      std::size_t equal = 0;
+      for (std::size_t i = 1; i < docs.size(); ++i)
+          equal += docs[i - 1] == docs[i];
+      return equal;
+  }
+}
+
+int main(int const argc, char const* argv[])
+{
+    int const failed = run_repr_bench("persistent", argc, argv);
+    std::size_t const n = parse_size(argc > 1 ? argv[1] : "100k");
+    std::size_t const versions = parse_size(argc > 2 ? argv[2] : "100k");
+
+    json_string keys[fanout];
+    for (std::size_t k = 0; k < fanout; ++k)
+        keys[k] = json_string("0123456789abcdef" + k, "0123456789abcdef" + k + 1);
+
+    std::size_t depth = 1, leaves = fanout;
+    while (leaves * fanout <= n)
+    {
+        ++depth;
+        leaves *= fanout;
+    }
+
+    std::printf("versions\n");
+    std::size_t const before = counting::allocated_bytes;
+    json_value const doc = tree(depth, keys);
+    std::size_t const bytes = counting::allocated_bytes - before;
+
+    std::vector<json_value> history;
+    history.reserve(versions);
+    std::size_t const kept = counting::allocated_bytes;
+    {
+        repr_bench::meter updating;
+        for (std::size_t i = 0; i < versions; ++i)
+        {
+            json_value next = history.empty() ? doc : history.back();
+            json_value* leaf = &next;
+            boost::uint64_t path = i * 0x9E3779B97F4A7C15ULL;
+            for (std::size_t d = 0; d < depth; ++d, path >>= 4)
+                leaf = &leaf->at(keys[path % fanout]);
+            *leaf = json_integer(i);
+            history.push_back(boost::move(next));
+        }
+        updating.report("update", versions, "version");
+    }
+    assert(history.empty() || history.back() != doc);
+
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    std::printf("  %lu leaves %lu deep in %lu bytes; each version added %.0f bytes, peak RSS %.1f MB\n",
+                (unsigned long)leaves, (unsigned long)depth, (unsigned long)bytes,
+                double(counting::allocated_bytes - kept) / versions, usage.ru_maxrss / 1024.0);
+    history.clear();
+
+    std::printf("dedup\n");
+    std::size_t const records = 8, pool = 64;
+    std::vector<json_value> docs;
+    std::size_t const live = counting::live_bytes;
+    {
+        boost::uint64_t seed = 1;
+        std::size_t values = 0;
+        while (values < n)
+        {
+            // One of 32 documents, so some are repeated
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            std::size_t const shape = seed >> 33 & 31;
+            json_array a;
+            for (std::size_t i = 0; i < records; ++i)
+                a.push_back(record((shape * 7 + i * 5) % pool, keys));
+            docs.push_back(json_value(boost::move(a)));
+            values += 1 + records * 10;
+        }
+    }
+    std::size_t const built = counting::live_bytes - live;
+
+    std::size_t equal;
+    {
+        repr_bench::meter comparing;
+        equal = adjacent_equal(docs);
+        comparing.report("== first", docs.size() - 1, "pair");
+    }
+    {
+        repr_bench::meter comparing;
+        std::size_t const same = adjacent_equal(docs);
+        comparing.report("== again", docs.size() - 1, "pair");
+        assert(same == equal);
+        keep(same);
+    }
+
+    json_cons_table table;
+    {
+        repr_bench::meter interning;
+        for (std::size_t i = 0; i < docs.size(); ++i)
+            docs[i] = table.intern(docs[i]);
+        interning.report("intern", docs.size(), "doc");
+    }
+    {
+        repr_bench::meter comparing;
+        std::size_t const same = adjacent_equal(docs);
+        comparing.report("== shared", docs.size() - 1, "pair");
+        assert(same == equal);
+        keep(same);
+    }
+    std::printf("  %lu documents, %lu equal to the next; %lu bytes built, %lu after interning, "
+                "%lu distinct nodes\n",
+                (unsigned long)docs.size(), (unsigned long)equal, (unsigned long)built,
+                (unsigned long)(counting::live_bytes - live), (unsigned long)table.size());
+    return failed;
+}
@@ -0,0 +1,325 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// JSON Pointer (RFC 6901) queries over a token stream.  The pointers
+// are compiled into a tree of path segments, and one pass over the
+// tokens follows only the members and elements some pointer names.
+// Every other subtree is skipped by counting brackets, without
+// decoding its strings or numbers, and only the values the pointers
+// reach are built as json_values.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_POINTER_TEST
+#endif
+
+#include "parse.cpp"
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class json_pointer_query
+{
+ public:
+    typedef std::vector<boost::optional<json_value> > results;
+
+    // Throws std::invalid_argument for a malformed pointer
+    explicit json_pointer_query(std::vector<std::string> const& pointers)
+      : nodes(1), count(pointers.size())
+    {
+        for (std::size_t i = 0; i < pointers.size(); ++i)
+            add(pointers[i], i);
+    }
+
+    // The value each pointer refers to, in the order given, or none if
+    // the document has no such value.  Like the parser, this expects
+    // valid JSON; validate untrusted text first.
+    template <class TokenIterator>
+    results operator()(TokenIterator tokens) const
+    {
+        results found(count);
+        json_parser parser;
+        json_atom_table atoms;
+        std::string scratch;
+        visit(tokens, 0, found, parser, atoms, scratch);
+        return found;
+    }
+
+    // Skip one value, counting brackets
+    template <class TokenIterator>
+    static void skip(TokenIterator& tokens)
+    {
+        std::size_t depth = 0;
+        do
+        {
+            char const c = *tokens->first;
+            if (c == '[' || c == '{')
+                ++depth;
+            else if (c == ']' || c == '}')
+                --depth;
+            ++tokens;
+        }
+        while (depth);
+    }
+
+ private:
+    struct node
+    {
+        std::vector<std::size_t> targets;   // pointers that end here
+        std::vector<std::pair<std::string, std::size_t> > members;
+        std::vector<std::pair<std::size_t, std::size_t> > elements;
+    };
+
+    void add(std::string const& pointer, std::size_t target)
+    {
+        if (!pointer.empty() && pointer[0] != '/')
+            throw std::invalid_argument("JSON Pointer must start with '/': " + pointer);
+
+        std::size_t n = 0;
+        for (std::size_t start = 0; start < pointer.size();)
+        {
+            std::size_t end = pointer.find('/', start + 1);
+            if (end == std::string::npos)
+                end = pointer.size();
+            n = child(n, unescape(pointer, start + 1, end));
+            start = end;
+        }
+        nodes[n].targets.push_back(target);
+    }
+
+    // ~1 is '/' and ~0 is '~'
+    static std::string unescape(std::string const& pointer, std::size_t first, std::size_t last)
+    {
+        std::string segment;
+        for (std::size_t i = first; i < last; ++i)
+        {
+            if (pointer[i] != '~')
+            {
+                segment += pointer[i];
+            }
+            else if (i + 1 < last && (pointer[i + 1] == '0' || pointer[i + 1] == '1'))
+            {
+                segment += pointer[++i] == '0' ? '~' : '/';
+            }
+            else
+            {
+                throw std::invalid_argument("bad escape in JSON Pointer: " + pointer);
+            }
+        }
+        return segment;
+    }
+
+    // The node for segment under node n, created if need be
+    std::size_t child(std::size_t n, std::string const& segment)
+    {
+        for (std::size_t i = 0; i < nodes[n].members.size(); ++i)
+        {
+            if (nodes[n].members[i].first == segment)
+                return nodes[n].members[i].second;
+        }
+
+        std::size_t const c = nodes.size();
+        nodes.push_back(node());
+        nodes[n].members.push_back(std::make_pair(segment, c));
+
+        // A segment that is an array index also names an element
+        bool const is_index = !segment.empty() && segment.size() < 19
+            && segment.find_first_not_of("0123456789") == std::string::npos
+            && (segment[0] != '0' || segment.size() == 1);
+        if (is_index)
+            nodes[n].elements.push_back(std::make_pair(std::size_t(std::atol(segment.c_str())), c));
+        return c;
+    }
+
+    std::size_t find_member(node const& at, string_span key) const
+    {
+        for (std::size_t i = 0; i < at.members.size(); ++i)
+        {
+            std::string const& s = at.members[i].first;
+            if (s.size() == std::size_t(key.size()) && std::equal(s.begin(), s.end(), key.begin()))
+                return at.members[i].second;
+        }
+        return 0;
+    }
+
+    std::size_t find_element(node const& at, std::size_t index) const
+    {
+        for (std::size_t i = 0; i < at.elements.size(); ++i)
+        {
+            if (at.elements[i].first == index)
+                return at.elements[i].second;
+        }
+        return 0;
+    }
+
+    // Drop what was found for node n and everything under it
+    void forget(std::size_t n, results& found) const
+    {
+        node const& at = nodes[n];
+        BOOST_FOREACH(std::size_t t, at.targets)
+            found[t] = boost::none;
+        for (std::size_t i = 0; i < at.members.size(); ++i)
+            forget(at.members[i].second, found);
+    }
+
+    // Consume the value at tokens, for node n.  Recursion is only as
+    // deep as the longest pointer.
+    template <class TokenIterator>
+    void visit(TokenIterator& tokens, std::size_t n, results& found,
+               json_parser& parser, json_atom_table& atoms, std::string& scratch) const
+    {
+        node const& at = nodes[n];
+        if (!at.targets.empty())
+        {
+            TokenIterator value = tokens;
+            json_value const v = parser.parse(value, atoms);
+            BOOST_FOREACH(std::size_t t, at.targets)
+                found[t] = v;
+            if (at.members.empty())
+            {
+                tokens = value;
+                return;
+            }
+        }
+
+        char const c = *tokens->first;
+        if (at.members.empty() || (c != '{' && c != '['))
+        {
+            skip(tokens);
+        }
+        else if (c == '{')
+        {
+            ++tokens;
+            while (*tokens->first != '}')
+            {
+                string_span const key = decode_json_string(*tokens++, scratch);
+                ++tokens;                               // :
+                if (std::size_t const m = find_member(at, key))
+                {
+                    // As in make_json_object(), the last of several
+                    // members with this key is the one that counts
+                    forget(m, found);
+                    visit(tokens, m, found, parser, atoms, scratch);
+                }
+                else
+                    skip(tokens);
+                if (*tokens->first == ',')
+                    ++tokens;
+            }
+            ++tokens;
+        }
+        else
+        {
+            ++tokens;
+            for (std::size_t i = 0; *tokens->first != ']'; ++i)
+            {
+                if (std::size_t const e = find_element(at, i))
+                    visit(tokens, e, found, parser, atoms, scratch);
+                else
+                    skip(tokens);
+                if (*tokens->first == ',')
+                    ++tokens;
+            }
+            ++tokens;
+        }
+    }
+
+    std::vector<node> nodes;    // nodes[0] is the whole document
+    std::size_t count;
+};
+
+inline json_pointer_query::results
+query_json(char const* first, char const* last, std::vector<std::string> const& pointers)
+{
+    return json_pointer_query(pointers)(tokens(first, last));
+}
+
+#ifdef BUILD_POINTER_TEST
+# include <iostream>
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+
+    std::vector<std::string> pointers;
+    pointers.push_back("/web-app/servlet/0/init-param/cachePagesTrack");
+    pointers.push_back("/web-app/servlet/4/servlet-name");
+    pointers.push_back("/web-app/taglib");
+    pointers.push_back("/web-app/no-such-key");
+    pointers.push_back("/web-app/servlet/5");
+    pointers.push_back("/web-app/servlet/-");
+    pointers.push_back("/web-app/servlet-mapping/cofaxCDS");
+    pointers.push_back("/web-app/taglib/taglib-uri");      // inside another match
+    pointers.push_back("/web-app/servlet/0/servlet-name/x");
+    pointers.push_back("");
+
+    json_pointer_query::results const r = query_json(input.begin(), input.end(), pointers);
+    for (std::size_t i = 0; i < pointers.size() - 1; ++i)
+    {
+        std::cout << pointers[i] << ": ";
+        if (r[i])
+            std::cout << *r[i];
+        std::cout << std::endl;
+    }
+
+    token_iterator toks = tokens(input);
+    json_value const everything = parse_json_value(toks);
+    json_object expected_taglib;
+    expected_taglib["taglib-uri"] = "cofax.tld";
+    expected_taglib["taglib-location"] = "/WEB-INF/tlds/cofax.tld";
+
+    assert(r[0] && *r[0] == json_value(200));
+    assert(r[1] && *r[1] == json_value("cofaxTools"));
+    assert(r[2] && *r[2] == json_value(expected_taglib));
+    assert(!r[3] && !r[4] && !r[5]);
+    assert(r[6] && *r[6] == json_value("/"));
+    assert(r[7] && *r[7] == json_value("cofax.tld"));
+    assert(!r[8]);
+    assert(r[9] && *r[9] == everything);
+
+    // Escapes in pointers and in keys; the last duplicate key wins
+    char const text[] = "{\"a/b\": {\"m~n\": [10, 20]}, \"\\u0063\": 1, \"c\": 2, \"\": 3}";
+    std::vector<std::string> escaped;
+    escaped.push_back("/a~1b/m~0n/1");
+    escaped.push_back("/c");
+    escaped.push_back("/");
+    json_pointer_query::results const e = query_json(text, text + sizeof(text) - 1, escaped);
+    assert(e[0] && *e[0] == json_value(20));
+    assert(e[1] && *e[1] == json_value(2));
+    assert(e[2] && *e[2] == json_value(3));
+
+    // A later duplicate replaces the whole of an earlier one, as it
+    // does for parse_json_value()
+    char const twice[] = "{\"a\": {\"x\": 1, \"y\": [1]}, \"a\": {\"y\": [2, 3]}}";
+    std::vector<std::string> deep;
+    deep.push_back("/a/x");
+    deep.push_back("/a/y/1");
+    deep.push_back("/a/y");
+    json_pointer_query::results const d = query_json(twice, twice + sizeof(twice) - 1, deep);
+    json_array expected_y;
+    expected_y.push_back(json_value(2));
+    expected_y.push_back(json_value(3));
+    assert(!d[0] && d[1] && *d[1] == json_value(3));
+    assert(d[2] && *d[2] == json_value(expected_y));
+
+    try
+    {
+        escaped.push_back("/bad~2");
+        json_pointer_query q(escaped);
+        assert(!"bad escape not detected");
+    }
+    catch(std::invalid_argument const&) {}
+    try
+    {
+        json_pointer_query q(std::vector<std::string>(1, "no-slash"));
+        assert(!"missing slash not detected");
+    }
+    catch(std::invalid_argument const&) {}
+}
+#endif
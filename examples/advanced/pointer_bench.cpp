@@ -0,0 +1,70 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Fetches two values from an array of copies of a file, with a JSON
+// Pointer query and by building the whole tree, over the scalar lexer
+// and over the structural index.
+//
+//   ./pointer_bench [file [size]]
+
+#define NO_TEST
+#include "pointer.cpp"
+#include "bench.hpp"
+
+template <class TokenIterator>
+struct query
+{
+    query(json_pointer_query const& q, TokenIterator tokens)
+      : q(q), tokens(tokens) {}
+
+    void operator()() const
+    {
+        keep(q(tokens));
+    }
+
+    json_pointer_query const& q;
+    TokenIterator tokens;
+};
+
+template <class TokenIterator>
+struct parse_all
+{
+    explicit parse_all(TokenIterator tokens) : tokens(tokens) {}
+
+    void operator()() const
+    {
+        TokenIterator toks = tokens;
+        keep(json_document(toks));
+    }
+
+    TokenIterator tokens;
+};
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::size_t const size = parse_size(argc > 2 ? argv[2] : "16M");
+    std::string const text = scale(input.begin(), input.end(), size);
+    char const* const first = text.data();
+    char const* const last = first + text.size();
+
+    // The first copy and the last
+    std::size_t const copies = (text.size() - 1) / (input.end() - input.begin() + 1);
+    char pointer[64];
+    std::vector<std::string> pointers(1, "/0/web-app/servlet/0/init-param/cachePagesTrack");
+    std::sprintf(pointer, "/%lu/web-app/servlet/4/servlet-name", (unsigned long)(copies - 1));
+    pointers.push_back(pointer);
+    json_pointer_query const q(pointers);
+
+    json_pointer_query::results const r = q(tokens(first, last));
+    assert(r[0] && *r[0] == json_value(200));
+    assert(r[1] && *r[1] == json_value("cofaxTools"));
+
+    report("scalar lexer, query", time_it(query<token_iterator>(q, tokens(first, last))), text.size());
+    report("scalar lexer, whole tree", time_it(parse_all<token_iterator>(tokens(first, last))), text.size());
+
+    structural_index const idx(first, last);
+    report("structural index, query", time_it(query<indexed_token_iterator>(q, tokens(idx))), text.size());
+    report("structural index, whole tree", time_it(parse_all<indexed_token_iterator>(tokens(idx))), text.size());
+}
@@ -0,0 +1,320 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REPR_BENCH_DWA2012_HPP
+# define REPR_BENCH_DWA2012_HPP
+
+// Measures whichever json_value design was included before this
+// header, so the designs can be compared on the same documents.  Each
+// *_bench.cpp driver for a design includes it, defining REPR_ORDERED
+// first if the design has == and <, REPR_EXPONENTIAL_LESS as well if
+// its < takes time exponential in nesting depth, and REPR_PARSES if it
+// has parse_json_value.  Every shape runs in its own process, so that
+// its peak RSS is its own.
+
+# include "bench.hpp"
+# include "alloc_count.hpp"
+# include <boost/move/move.hpp>
+# include <boost/cstdint.hpp>
+# include <algorithm>
+# include <cassert>
+# include <cstdio>
+# include <sstream>
+# include <string>
+# include <sys/resource.h>
+# include <sys/wait.h>
+# include <unistd.h>
+
+namespace repr_bench
+{
+  enum shape { wide, deep, numbers, strings, shapes };
+
+  char const* const shape_names[] = {
+      "wide objects", "deep nesting", "numeric arrays", "strings"
+  };
+
+  // Generates the same documents for every design, counting the values
+  // it creates
+  class builder
+  {
+   public:
+      builder() : seed(1), nodes(0) {}
+
+      // The values at the top of a document of about n values
+      json_array items(shape s, std::size_t n)
+      {
+          json_array a;
+          while (nodes < n)
+              a.push_back(item(s));
+          return a;
+      }
+
+      // A wide document is one object; the rest are arrays
+      json_value document(shape s, std::size_t n)
+      {
+          ++nodes;
+          if (s != wide)
+          {
+              json_array a = items(s, n);
+              return json_value(boost::move(a));
+          }
+
+          json_object o;
+          char key[24];
+          for (unsigned long i = 0; nodes < n; ++i)
+          {
+              std::sprintf(key, "k%07lu", i);
+              o[key] = item(s);
+          }
+          return json_value(boost::move(o));
+      }
+
+      // Values created so far
+      std::size_t size() const { return nodes; }
+
+   private:
+      boost::uint64_t next()
+      {
+          seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+          return seed >> 11;
+      }
+
+      json_value item(shape s)
+      {
+          switch (s)
+          {
+          case wide: return record();
+          case deep: return chain(32);
+          case numbers: return number();
+          default: return string();
+          }
+      }
+
+      json_value integer()
+      {
+          ++nodes;
+          return json_value(json_integer(next() % 1000000));
+      }
+
+      json_value number()
+      {
+          ++nodes;
+          return json_value(json_float(next() % 100000000) / 1024);
+      }
+
+      // Mostly short, sometimes long, with the occasional escape
+      json_value string()
+      {
+          ++nodes;
+          std::size_t const length = next() % 4 ? 8 + next() % 16 : 64 + next() % 448;
+          json_string s;
+          for (std::size_t i = 0; i < length; ++i)
+          {
+              boost::uint64_t const r = next();
+              s += r % 64 ? char('a' + r % 26) : "\"\\\n"[r / 64 % 3];
+          }
+          return json_value(boost::move(s));
+      }
+
+      json_value record()
+      {
+          ++nodes;
+          json_object r;
+          r["id"] = integer();
+          r["score"] = number();
+          r["tag"] = string();
+          ++nodes;
+          r["ok"] = json_value(next() % 2 == 0);
+          return json_value(boost::move(r));
+      }
+
+      // Arrays and objects, alternately, around one integer
+      json_value chain(std::size_t depth)
+      {
+          json_value v = integer();
+          for (std::size_t d = 0; d < depth; ++d)
+          {
+              ++nodes;
+              if (d % 2)
+              {
+                  json_array a;
+                  a.push_back(boost::move(v));
+                  v = json_value(boost::move(a));
+              }
+              else
+              {
+                  json_object o;
+                  o["child"] = boost::move(v);
+                  v = json_value(boost::move(o));
+              }
+          }
+          return v;
+      }
+
+      boost::uint64_t seed;
+      std::size_t nodes;
+  };
+
+  // Time and allocations from construction until report()
+  class meter
+  {
+   public:
+      meter()
+        : allocations(counting::allocations),
+          bytes(counting::allocated_bytes),
+          start(now())
+      {}
+
+      void report(char const* what, std::size_t ops, char const* unit = "value") const
+      {
+          double const seconds = now() - start;
+          std::printf("  %-10s %9.1f ns/%-5s %10lu allocations %12lu bytes\n",
+                      what, seconds / ops * 1e9, unit,
+                      (unsigned long)(counting::allocations - allocations),
+                      (unsigned long)(counting::allocated_bytes - bytes));
+          std::fflush(stdout);
+      }
+
+   private:
+      std::size_t const allocations;
+      std::size_t const bytes;
+      double const start;
+  };
+
+  inline void not_applicable(char const* what, char const* why)
+  {
+      std::printf("  %-10s       n/a  (%s)\n", what, why);
+      std::fflush(stdout);
+  }
+
+  inline void run(shape s, std::size_t n)
+  {
+      builder b;
+      json_array items = builder().items(s, n);
+
+      meter constructing;
+      json_value doc = b.document(s, n);
+      constructing.report("construct", b.size());
+      std::size_t const values = b.size();
+
+      json_value* copy;
+      {
+          meter copying;
+          copy = new json_value(doc);
+          copying.report("copy", values);
+      }
+
+      {
+          std::size_t const moves = 1000000;
+          meter moving;
+          for (std::size_t i = 0; i < moves; i += 2)
+          {
+              json_value moved(boost::move(doc));
+              doc = boost::move(moved);
+          }
+          moving.report("move", moves, "move");
+      }
+
+# ifdef REPR_ORDERED
+      {
+          meter comparing;
+          bool const same = *copy == doc;
+          comparing.report("==", values);
+          assert(same);
+          keep(same);
+      }
+#  ifdef REPR_EXPONENTIAL_LESS
+      // < compares each pair of elements both ways, so comparing two
+      // chains takes time exponential in their depth
+      if (s == deep)
+      {
+          not_applicable("sort", "< is exponential in nesting depth");
+      }
+      else
+#  endif
+      {
+          json_array sorted(items);
+          meter sorting;
+          std::sort(sorted.begin(), sorted.end());
+          sorting.report("sort", values);
+          keep(sorted);
+      }
+# else
+      not_applicable("==", "no comparison operators");
+      not_applicable("sort", "no comparison operators");
+# endif
+
+      std::string text;
+      {
+          meter printing;
+          std::ostringstream s;
+          s << doc;
+          text = s.str();
+          printing.report("print", values);
+      }
+
+# ifdef REPR_PARSES
+      {
+          meter parsing;
+          token_iterator toks = tokens(text);
+          json_value const parsed = parse_json_value(toks);
+          parsing.report("parse", values);
+#  ifdef REPR_ORDERED
+          assert(parsed == doc);
+#  endif
+      }
+# else
+      not_applicable("parse", "no parser");
+# endif
+
+      {
+          meter destroying;
+          delete copy;
+          destroying.report("destroy", values);
+      }
+
+      rusage usage;
+      ::getrusage(RUSAGE_SELF, &usage);
+      std::printf("  %lu values, %lu bytes printed, peak RSS %.1f MB\n",
+                  (unsigned long)values, (unsigned long)text.size(), usage.ru_maxrss / 1024.0);
+  }
+}
+
+// Runs every shape with about argv[1] values per document (default
+// 100k); returns nonzero if any run failed
+inline int run_repr_bench(char const* design, int argc, char const* argv[])
+{
+    std::size_t const n = parse_size(argc > 1 ? argv[1] : "100k");
+    std::printf("%s: sizeof(json_value) = %lu\n", design, (unsigned long)sizeof(json_value));
+
+    int failures = 0;
+    for (int s = 0; s < repr_bench::shapes; ++s)
+    {
+        std::printf("%s\n", repr_bench::shape_names[s]);
+        std::fflush(stdout);
+
+        pid_t const child = ::fork();
+        if (child < 0)
+        {
+            std::perror("fork");
+            return 1;
+        }
+        if (child == 0)
+        {
+            repr_bench::run(repr_bench::shape(s), n);
+            std::fflush(stdout);
+            ::_exit(0);
+        }
+
+        int status;
+        ::waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::printf("  failed\n");
+            ++failures;
+        }
+    }
+    return failures != 0;
+}
+
+#endif // REPR_BENCH_DWA2012_HPP
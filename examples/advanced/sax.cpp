@@ -0,0 +1,552 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// A push parser: feed it JSON text in chunks of any size, and it calls
+// a handler for each event (start_object, key, value, ...).  Its state
+// survives chunk boundaries anywhere, even inside a string or number,
+// and the only memory it holds is a container stack and the text of
+// the current string or number, so arbitrarily large documents can be
+// processed in bounded space.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_SAX_TEST
+#endif
+
+#include "parse.cpp"
+#include <boost/utility/base_from_member.hpp>
+#include <string>
+#include <vector>
+
+template <class Handler>
+class json_push_parser
+{
+ public:
+    explicit json_push_parser(Handler& handler)
+      : handler(handler), state(value_expected), pending_surrogate(0), offset(0)
+    {}
+
+    // Parse the next chunk of input; throws json_lex_error, with the
+    // offset counted from the start of the whole input, on bad JSON
+    void feed(char const* first, char const* last)
+    {
+        chunk_start = first;
+        for (char const* p = first; p != last;)
+            p = step(p, last);
+        offset += last - first;
+    }
+
+    void feed(std::string const& s)
+    {
+        feed(s.data(), s.data() + s.size());
+    }
+
+    // Signal the end of input.  A number at the very end of a chunk
+    // can't be finished until now.
+    void finish()
+    {
+        chunk_start = 0;
+        if (state == in_number)
+            end_number(0);
+        if (state != done)
+            error(0);
+    }
+
+    // true once a complete top-level value has been seen
+    bool complete() const { return state == done; }
+
+ private:
+    enum state_t
+    {
+        value_expected,         // after ':' or ',' in an array, or at the start
+        value_or_end,           // just after '['
+        key_expected,           // after ',' in an object
+        key_or_end,             // just after '{'
+        colon_expected,
+        comma_or_end,
+        in_string,              // also keys; see in_key
+        in_escape,              // just after '\\'
+        in_unicode,             // inside \uXXXX
+        in_number,
+        in_literal,
+        done
+    };
+
+    // Consume as much of [p, last) as the current state can, and
+    // return where to continue
+    char const* step(char const* p, char const* last)
+    {
+        switch (state)
+        {
+        case in_string:
+            return scan_string(p, last);
+        case in_escape:
+            return scan_escape(p);
+        case in_unicode:
+            return scan_unicode(p);
+        case in_number:
+            return scan_number(p, last);
+        case in_literal:
+            return scan_literal(p);
+        default:
+            break;
+        }
+
+        if (lex::flags[(unsigned char)*p] & lex::space)
+            return p + 1;
+
+        char const c = *p;
+        switch (state)
+        {
+        case value_or_end:
+            if (c == ']')
+                return close(p, '[');
+            // fall through
+        case value_expected:
+            return start_value(p);
+
+        case key_or_end:
+            if (c == '}')
+                return close(p, '{');
+            // fall through
+        case key_expected:
+            if (c != '"')
+                error(p);
+            text.clear();
+            in_key = true;
+            state = in_string;
+            return p + 1;
+
+        case colon_expected:
+            if (c != ':')
+                error(p);
+            state = value_expected;
+            return p + 1;
+
+        case comma_or_end:
+            if (c == ',')
+            {
+                state = stack.back() == '{' ? key_expected : value_expected;
+                return p + 1;
+            }
+            return close(p, c == ']' ? '[' : c == '}' ? '{' : 0);
+
+        default:    // done: only whitespace may follow
+            error(p);
+            return p;
+        }
+    }
+
+    char const* start_value(char const* p)
+    {
+        switch (*p)
+        {
+        case '[':
+            stack.push_back('[');
+            handler.start_array();
+            state = value_or_end;
+            return p + 1;
+        case '{':
+            stack.push_back('{');
+            handler.start_object();
+            state = key_or_end;
+            return p + 1;
+        case '"':
+            text.clear();
+            in_key = false;
+            state = in_string;
+            return p + 1;
+        case 't': literal = "true"; break;
+        case 'f': literal = "false"; break;
+        case 'n': literal = "null"; break;
+        default:
+            text.clear();
+            number_state = lex::s_start;
+            state = in_number;
+            return p;
+        }
+        matched = 0;
+        state = in_literal;
+        return p;
+    }
+
+    // Close the innermost container, which must have been opened by open
+    char const* close(char const* p, char open)
+    {
+        if (stack.empty() || stack.back() != open)
+            error(p);
+        stack.pop_back();
+        if (open == '[')
+            handler.end_array();
+        else
+            handler.end_object();
+        end_value();
+        return p + 1;
+    }
+
+    void end_value()
+    {
+        state = stack.empty() ? done : comma_or_end;
+    }
+
+    char const* scan_string(char const* p, char const* last)
+    {
+        if (pending_surrogate && *p != '\\')
+            unpaired_surrogate();
+
+        char const* const run = p;
+        while (p != last && !(lex::flags[(unsigned char)*p] & lex::string_stop))
+            ++p;
+        text.append(run, p);
+
+        if (p == last)
+            return p;
+        if (*p == '\\')
+        {
+            state = in_escape;
+            return p + 1;
+        }
+        if (*p != '"')                  // unescaped control character
+            error(p);
+
+        string_span const s(text.data(), text.data() + text.size());
+        if (in_key)
+        {
+            handler.key(s);
+            state = colon_expected;
+        }
+        else
+        {
+            handler.value(s);
+            end_value();
+        }
+        return p + 1;
+    }
+
+    char const* scan_escape(char const* p)
+    {
+        char c = *p;
+        switch (c)
+        {
+        case 'u':
+            code_point = 0;
+            hex_digits = 0;
+            state = in_unicode;
+            return p + 1;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case '"':
+        case '\\':
+        case '/':
+            break;
+        default:
+            error(p);
+        }
+        if (pending_surrogate)
+            unpaired_surrogate();
+        text += c;
+        state = in_string;
+        return p + 1;
+    }
+
+    char const* scan_unicode(char const* p)
+    {
+        unsigned char const c = *p;
+        if (!(lex::flags[c] & lex::hex))
+            error(p);
+        code_point = code_point * 16
+            + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        if (++hex_digits < 4)
+            return p + 1;
+
+        state = in_string;
+        if (code_point >= 0xDC00 && code_point < 0xE000 && pending_surrogate)
+        {
+            code_point = 0x10000 + ((pending_surrogate - 0xD800) << 10)
+                + (code_point - 0xDC00);
+            pending_surrogate = 0;
+        }
+        else if (pending_surrogate)
+        {
+            unpaired_surrogate();
+        }
+
+        if (code_point >= 0xD800 && code_point < 0xDC00)     // high surrogate
+            pending_surrogate = code_point;
+        else if (code_point >= 0xDC00 && code_point < 0xE000)
+            append_utf8(0xFFFD);
+        else
+            append_utf8(code_point);
+        return p + 1;
+    }
+
+    // As unescape_in_place() does, a high surrogate that isn't followed
+    // at once by a low one becomes U+FFFD
+    void unpaired_surrogate()
+    {
+        append_utf8(0xFFFD);
+        pending_surrogate = 0;
+    }
+
+    void append_utf8(unsigned long c)
+    {
+        char buffer[4];
+        text.append(buffer, encode_utf8(c, buffer));
+    }
+
+    char const* scan_number(char const* p, char const* last)
+    {
+        char const* const run = p;
+        for (; p != last; ++p)
+        {
+            int const next = lex::number_transitions[number_state][lex::number_class(*p)];
+            if (next == lex::s_reject)
+                break;
+            number_state = next;
+        }
+        text.append(run, p);
+
+        if (p != last)
+            end_number(p);
+        return p;
+    }
+
+    void end_number(char const* p)
+    {
+        if (!lex::accepts_number(number_state))
+            error(p);
+
+        json_integer i;
+        json_float f;
+        if (decode_json_number(text.data(), text.data() + text.size(), i, f))
+            handler.value(i);
+        else
+            handler.value(f);
+        end_value();
+    }
+
+    char const* scan_literal(char const* p)
+    {
+        if (*p != literal[matched])
+            error(p);
+        if (literal[++matched] != 0)
+            return p + 1;
+
+        switch (*literal)
+        {
+        case 't': handler.value(true); break;
+        case 'f': handler.value(false); break;
+        default: handler.value(json_null());
+        }
+        end_value();
+        return p + 1;
+    }
+
+    // p is in the current chunk, or 0 for the end of input
+    void error(char const* p) const
+    {
+        throw json_lex_error(p ? offset + (p - chunk_start) : offset);
+    }
+
+    Handler& handler;
+    state_t state;
+    std::vector<char> stack;    // '[' or '{' per open container
+    std::string text;           // the string or number being scanned
+
+    bool in_key;
+    unsigned long code_point;
+    unsigned long pending_surrogate;    // first half of a \u pair
+    int hex_digits;
+    int number_state;
+    char const* literal;
+    int matched;                // characters of literal seen so far
+
+    std::size_t offset;         // input consumed before this chunk
+    char const* chunk_start;
+};
+
+// A json_tree_builder, the one json_parser uses, for the push parser:
+// it builds the same trees as parse_json_value(), with the same
+// max_depth and hash_threshold.  Without a json_atom_table of the
+// caller's, it interns keys in one of its own.
+class json_dom_builder
+  : private boost::base_from_member<json_atom_table>,
+    public json_tree_builder
+{
+    typedef boost::base_from_member<json_atom_table> own_atoms;
+
+ public:
+    explicit json_dom_builder(
+        std::size_t max_depth = json_tree_builder::default_max_depth,
+        std::size_t hash_threshold = json_object::default_hash_threshold)
+      : json_tree_builder(own_atoms::member, max_depth, hash_threshold)
+    {}
+
+    explicit json_dom_builder(
+        json_atom_table& atoms,
+        std::size_t max_depth = json_tree_builder::default_max_depth,
+        std::size_t hash_threshold = json_object::default_hash_threshold)
+      : json_tree_builder(atoms, max_depth, hash_threshold)
+    {}
+};
+
+// Parse a whole document through the push parser
+inline json_value parse_json_stream(char const* first, char const* last)
+{
+    json_dom_builder builder;
+    json_push_parser<json_dom_builder> parser(builder);
+    parser.feed(first, last);
+    parser.finish();
+    return MOVE(builder.result());
+}
+
+#ifdef BUILD_SAX_TEST
+# include <iostream>
+
+// Counts events without building anything
+struct event_counter : json_handler
+{
+    event_counter() : containers(0), scalars(0) {}
+
+    void start_object() { ++containers; }
+    void start_array() { ++containers; }
+    template <class T> void value(T) { ++scalars; }
+
+    std::size_t containers, scalars;
+};
+
+// The object v holds, or 0
+struct object_of : boost::static_visitor<json_object const*>
+{
+    template <class T>
+    json_object const* operator()(T const&) const { return 0; }
+    json_object const* operator()(json_object const& o) const { return &o; }
+};
+
+json_value parse_in_chunks(char const* first, char const* last, std::size_t chunk)
+{
+    json_dom_builder builder;
+    json_push_parser<json_dom_builder> parser(builder);
+    for (; std::size_t(last - first) > chunk; first += chunk)
+        parser.feed(first, first + chunk);
+    parser.feed(first, last);
+    parser.finish();
+    return builder.result();
+}
+
+json_value parse_in_chunks(std::string const& s, std::size_t chunk)
+{
+    return parse_in_chunks(s.data(), s.data() + s.size(), chunk);
+}
+
+// Returns the error offset the push parser reports for s, or -1
+long stream_error(std::string const& s, std::size_t chunk = 1)
+{
+    try
+    {
+        parse_in_chunks(s, chunk);
+    }
+    catch(json_lex_error const& e)
+    {
+        return e.offset;
+    }
+    return -1;
+}
+
+int main(int const argc, char const* argv[])
+{
+    // "./sax --count big.json" streams the file through an event
+    // counter in 64K reads, with no document held in memory
+    if (argc > 1 && std::string(argv[1]) == "--count")
+    {
+        int const fd = argc > 2 ? ::open(argv[2], O_RDONLY) : 0;
+        event_counter counter;
+        json_push_parser<event_counter> parser(counter);
+        char buffer[64 * 1024];
+        for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;)
+            parser.feed(buffer, buffer + n);
+        parser.finish();
+        std::cout << counter.containers << " containers, "
+                  << counter.scalars << " scalars" << std::endl;
+        return 0;
+    }
+
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    token_iterator toks = tokens(input);
+    json_value const expected = parse_json_value(toks);
+
+    std::size_t const chunks[] = { 1, 2, 3, 7, 64, 4096, input.size() };
+    BOOST_FOREACH(std::size_t chunk, chunks)
+        assert(parse_in_chunks(input.begin(), input.end(), chunk) == expected);
+
+    for (std::size_t chunk = 1; chunk < 8; ++chunk)
+    {
+        json_array a;
+        a.push_back(json_integer(-120));
+        a.push_back(json_float(1e5));
+        a.push_back(json_float(0.25));
+        a.push_back(json_null());
+        a.push_back(false);
+        a.push_back(json_string("\"/\n\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e"));
+        a.push_back(json_array());
+        a.push_back(json_object());
+        assert(parse_in_chunks(
+                   " [ -120, 1e5, 0.25, null, false,"
+                   " \"\\\"\\/\\n\\u00e9\\u20AC\\ud834\\udd1e\", [], {} ] ", chunk) == a);
+
+        assert(parse_in_chunks("42", chunk) == json_value(42));
+    }
+
+    // Unpaired surrogates become U+FFFD, as parse_json_value() has them
+    char const* const surrogates[] = {
+        "\"\\ud834x\"", "\"\\ud834\"", "\"\\udd1e\\ud834\"", "\"\\ud834\\n\"",
+        "\"\\ud834\\ud834\\udd1e\"", "\"\\ud834\\u0041\"", "\"a\\udd1e\\udd1e\""
+    };
+    BOOST_FOREACH(char const* text, surrogates)
+    {
+        token_iterator t = tokens(text, text + std::strlen(text));
+        json_value const dom = parse_json_value(t);
+        for (std::size_t chunk = 1; chunk < 4; ++chunk)
+            assert(parse_in_chunks(text, chunk) == dom);
+    }
+    assert(parse_in_chunks("\"\\ud834x\"", 1) == json_value(json_string("\xef\xbf\xbdx")));
+
+    // The builder takes json_parser's limits, and its atom table's arena
+    {
+        json_dom_builder shallow(2);
+        json_push_parser<json_dom_builder> parser(shallow);
+        bool threw = false;
+        try { parser.feed(std::string("[[[1]]]")); }
+        catch(json_depth_error const&) { threw = true; }
+        assert(threw);
+
+        arena memory;
+        json_atom_table atoms(&memory);
+        json_dom_builder hashing(atoms, json_parser::default_max_depth, 0);
+        json_push_parser<json_dom_builder> p(hashing);
+        p.feed(std::string("{\"b\": \"some text that is long enough\", \"a\": [1]}"));
+        p.finish();
+        json_object const* const o = boost::apply_visitor(object_of(), hashing.result());
+        assert(o && o->hashed() && o->begin()->first == "b");
+        assert(o->get_allocator() == arena_allocator<char>(&memory));
+    }
+
+    assert(stream_error("[1 2]") == 3);
+    assert(stream_error("[1, tru]") == 7);
+    assert(stream_error("{\"a\" 1}") == 5);
+    assert(stream_error("[1,]") == 3);
+    assert(stream_error("[1}") == 2);
+    assert(stream_error("[\"a\\q\"]") == 4);
+    assert(stream_error("[01]") == 2);
+    assert(stream_error("[1.]") == 3);
+    assert(stream_error("[1") == 2);
+    assert(stream_error("1 2") == 2);
+    assert(stream_error("-") == 1);
+}
+#endif
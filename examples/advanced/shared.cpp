@@ -294,6 +294,9 @@ inline std::ostream& operator<<(std::ostream& s, json_object const& o)
     return s;
 }
 
+// ------------ test driver --------------
+
+#ifndef NO_TEST
 #include <iostream>
 
 int main()
@@ -318,3 +321,4 @@ int main()
 
     v = json_value(1);
 }
+#endif
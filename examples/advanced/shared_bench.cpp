@@ -0,0 +1,17 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over shared.cpp's json_value, which holds a
+// shared_ptr<json_base>, so its copies share one value
+//
+//   ./shared_bench [values]
+
+#define NO_TEST
+#include "shared.cpp"
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("shared_ptr erasure (copies share)", argc, argv);
+}
@@ -0,0 +1,499 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SHORTEST_FLOAT_DWA2012_HPP
+# define SHORTEST_FLOAT_DWA2012_HPP
+
+//
+// Shortest round-trip text for binary floating-point numbers: the
+// fewest significant digits that read back as exactly the same value.
+// Digits come from Steele & White's free-format algorithm, as refined
+// by Burger & Dybvig, run on exact scaled integers.  The integers are
+// only as long as the exponent requires, so ordinary values take a
+// few machine words; works for float, double and long double.
+//
+
+# include <boost/cstdint.hpp>
+# include <boost/static_assert.hpp>
+# include <algorithm>
+# include <cassert>
+# include <cmath>
+# include <cstring>
+# include <limits>
+
+namespace shortest_float
+{
+  // A nonnegative integer in 32-bit limbs, least significant first,
+  // big enough for any long double scaled by a power of ten
+  class bignum
+  {
+   public:
+      enum { capacity = 540 };
+
+      explicit bignum(boost::uint64_t x = 0) : size(0)
+      {
+          for (; x; x >>= 32)
+              limbs[size++] = boost::uint32_t(x);
+      }
+
+      bignum(bignum const& x) : size(x.size)
+      {
+          std::memcpy(limbs, x.limbs, size * sizeof(limbs[0]));
+      }
+
+      bignum& operator=(bignum const& x)
+      {
+          size = x.size;
+          std::memcpy(limbs, x.limbs, size * sizeof(limbs[0]));
+          return *this;
+      }
+
+      void multiply(boost::uint32_t m)
+      {
+          boost::uint64_t carry = 0;
+          for (int i = 0; i < size; ++i)
+          {
+              carry += boost::uint64_t(limbs[i]) * m;
+              limbs[i] = boost::uint32_t(carry);
+              carry >>= 32;
+          }
+          if (carry)
+              push(boost::uint32_t(carry));
+      }
+
+      void multiply_pow10(int n)
+      {
+          static boost::uint32_t const small[] = {
+              1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+          };
+          for (; n >= 9; n -= 9)
+              multiply(1000000000);
+          if (n)
+              multiply(small[n]);
+      }
+
+      void multiply_pow2(int n)
+      {
+          if (!size)
+              return;
+          int const words = n / 32;
+          int const bits = n % 32;
+          assert(size + words + 1 <= capacity);
+          if (bits)
+          {
+              limbs[size] = 0;
+              for (int i = size; i > 0; --i)
+                  limbs[i] = limbs[i] << bits | limbs[i - 1] >> (32 - bits);
+              limbs[0] <<= bits;
+              size += limbs[size] != 0;
+          }
+          if (words)
+          {
+              std::memmove(limbs + words, limbs, size * sizeof(limbs[0]));
+              std::fill(limbs, limbs + words, 0u);
+              size += words;
+          }
+      }
+
+      void add(bignum const& x)
+      {
+          boost::uint64_t carry = 0;
+          int const n = std::max(size, x.size);
+          for (int i = 0; i < n; ++i)
+          {
+              carry += boost::uint64_t(i < size ? limbs[i] : 0) + (i < x.size ? x.limbs[i] : 0);
+              limbs[i] = boost::uint32_t(carry);
+              carry >>= 32;
+          }
+          size = n;
+          if (carry)
+              push(boost::uint32_t(carry));
+      }
+
+      // Requires *this >= x
+      void subtract(bignum const& x)
+      {
+          boost::int64_t borrow = 0;
+          for (int i = 0; i < size; ++i)
+          {
+              borrow += boost::int64_t(limbs[i]) - (i < x.size ? x.limbs[i] : 0);
+              limbs[i] = boost::uint32_t(borrow);
+              borrow >>= 32;
+          }
+          assert(borrow == 0);
+          while (size && !limbs[size - 1])
+              --size;
+      }
+
+      // Divides by s, leaving the remainder, when the quotient is a
+      // single decimal digit
+      int divide_digit(bignum const& s)
+      {
+          assert(s.size > 0);
+          if (size < s.size)
+              return 0;
+
+          int q;
+          if (s.size == 1)
+          {
+              boost::uint64_t const n = size > 1 ? boost::uint64_t(limbs[1]) << 32 | limbs[0] : limbs[0];
+              q = int(n / s.limbs[0]);
+          }
+          else
+          {
+              // Two leading limbs of s, and r at the same scale, give
+              // the quotient within one
+              int const i = s.size - 2;
+              double const r_top = (limb(i + 2) * 4294967296.0 + limb(i + 1)) * 4294967296.0 + limb(i);
+              double const s_top = s.limbs[i + 1] * 4294967296.0 + s.limbs[i];
+              q = std::max(int(r_top / s_top) - 1, 0);
+          }
+          subtract_multiple(s, q);
+          while (compare(*this, s) >= 0)
+          {
+              subtract(s);
+              ++q;
+          }
+          return q;
+      }
+
+      friend int compare(bignum const& x, bignum const& y)
+      {
+          if (x.size != y.size)
+              return x.size < y.size ? -1 : 1;
+          for (int i = x.size; i-- > 0;)
+          {
+              if (x.limbs[i] != y.limbs[i])
+                  return x.limbs[i] < y.limbs[i] ? -1 : 1;
+          }
+          return 0;
+      }
+
+      // The sign of x + y - z
+      friend int compare_sum(bignum const& x, bignum const& y, bignum const& z)
+      {
+          int const n = std::max(std::max(x.size, y.size), z.size);
+          boost::int64_t carry = 0;
+          bool nonzero = false;
+          for (int i = 0; i < n; ++i)
+          {
+              carry += boost::int64_t(x.limb(i)) + y.limb(i) - z.limb(i);
+              nonzero |= boost::uint32_t(carry) != 0;
+              carry >>= 32;
+          }
+          return carry < 0 ? -1 : carry > 0 || nonzero ? 1 : 0;
+      }
+
+   private:
+      boost::uint32_t limb(int i) const
+      {
+          return i < size ? limbs[i] : 0;
+      }
+
+      // Requires *this >= q * s
+      void subtract_multiple(bignum const& s, int q)
+      {
+          if (q == 0)
+              return;
+          boost::uint64_t carry = 0;
+          boost::int64_t borrow = 0;
+          for (int i = 0; i < size; ++i)
+          {
+              carry += boost::uint64_t(s.limb(i)) * boost::uint32_t(q);
+              borrow += boost::int64_t(limbs[i]) - boost::int64_t(boost::uint32_t(carry));
+              carry >>= 32;
+              limbs[i] = boost::uint32_t(borrow);
+              borrow >>= 32;
+          }
+          assert(borrow == 0 && carry == 0);
+          while (size && !limbs[size - 1])
+              --size;
+      }
+
+      void push(boost::uint32_t x)
+      {
+          assert(size < capacity);
+          limbs[size++] = x;
+      }
+
+      int size;
+      boost::uint32_t limbs[capacity];
+  };
+
+  // 10^0 ... 10^max, the powers of ten that are exact in Float
+  template <class Float>
+  struct exact_powers_of_ten
+  {
+      // 5^max < 2^digits
+      enum { max = std::numeric_limits<Float>::digits * 3 / 7 };
+
+      exact_powers_of_ten()
+      {
+          Float p = 1;
+          for (int i = 0; i <= max; ++i, p *= 10)
+              table[i] = p;
+      }
+
+      Float table[max + 1];
+  };
+
+  // Writes the digits of n, without trailing zeros, to out and returns
+  // their number; adds the number of digits in n to exponent
+  inline int integer_digits(boost::uint64_t n, char* out, int& exponent)
+  {
+      while (n % 10 == 0)
+      {
+          n /= 10;
+          ++exponent;
+      }
+      char text[20];
+      char* p = text + sizeof(text);
+      do
+      {
+          *--p = char('0' + n % 10);
+          n /= 10;
+      }
+      while (n);
+      int const count = int(text + sizeof(text) - p);
+      std::memcpy(out, p, count);
+      exponent += count;
+      return count;
+  }
+
+  // The fast path, for x read from a few decimal digits: the fewest
+  // fraction digits j for which x == D / 10^j.  Below 2^(digits - 2),
+  // x * 10^j is computed within 1/8, so the only candidates for D are
+  // the integers on either side of it, and since D and 10^j are exact,
+  // D / 10^j is correctly rounded and can be compared with x.  Returns
+  // 0 if x is out of range, or if the nearer of two candidates that
+  // both read back as x is in doubt.
+  template <class Float>
+  int few_digits(Float x, char* out, int& exponent)
+  {
+      typedef std::numeric_limits<Float> limits;
+      static exact_powers_of_ten<Float> const powers;
+      Float const limit = std::ldexp(Float(1), limits::digits - 2);
+
+      // Adding and subtracting this rounds anything below limit to an
+      // integer, without a conversion
+      Float const rounder = Float(boost::uint64_t(1) << (limits::digits - 1));
+
+      for (int j = 0; j <= powers.max; ++j)
+      {
+          Float const scaled = x * powers.table[j];
+          if (!(scaled < limit))
+              return 0;
+
+          // D reads back as x only if it is within about an ulp of x,
+          // times 10^j, of scaled; don't divide unless it could be
+          Float const nearest = (scaled + rounder) - rounder;
+          Float const reach = 4 * limits::epsilon() * scaled;
+          if (std::fabs(scaled - nearest) > reach)
+              continue;
+
+          boost::uint64_t const below = boost::uint64_t(nearest > scaled ? nearest - 1 : nearest);
+          Float const fraction = scaled - Float(below);
+
+          bool const low = below != 0 && Float(below) / powers.table[j] == x;
+          bool const high = Float(below + 1) / powers.table[j] == x;
+          if (!low && !high)
+              continue;
+          if (low && high && fraction > Float(0.375) && fraction < Float(0.625))
+              return 0;
+
+          exponent = -j;
+          return integer_digits(below + (high && (!low || fraction >= Float(0.5))), out, exponent);
+      }
+      return 0;
+  }
+
+  // The shortest significant digits of x, finite and positive, such
+  // that x == 0.digits * 10^exponent after reading back.  Returns the
+  // number of digits written to out, at most max_digits10.
+  template <class Float>
+  int digits(Float x, char* out, int& exponent)
+  {
+      typedef std::numeric_limits<Float> limits;
+      BOOST_STATIC_ASSERT(limits::digits <= 64);
+      assert(x > 0 && x <= limits::max());
+
+      if (int const n = few_digits(x, out, exponent))
+          return n;
+
+      // x == f * 2^e exactly, with f's gap to its neighbors fixed for
+      // subnormals
+      int binary_exponent;
+      Float const m = std::frexp(x, &binary_exponent);
+      // Converting from below 2^(digits - 1) is much faster on x87
+      Float const half = Float(boost::uint64_t(1) << (limits::digits - 1));
+      boost::uint64_t f = (boost::uint64_t(1) << (limits::digits - 1))
+          + boost::uint64_t(std::ldexp(m, limits::digits) - half);
+
+      // 2^(binary_exponent - 1) <= x, so this is ceil(log10(x)) or one
+      // less
+      int k = int(std::ceil((binary_exponent - 1) * 0.30102999566398119521 - 1e-10));
+
+      if (binary_exponent < limits::min_exponent)
+      {
+          f >>= limits::min_exponent - binary_exponent;
+          binary_exponent = limits::min_exponent;
+      }
+      int const e = binary_exponent - limits::digits;
+
+      // x is (r / s), and its neighbors are half-way at (r - m_minus) / s
+      // and (r + m_plus) / s.  Below a power of two the gap is halved.
+      bool const unequal_gaps = f == boost::uint64_t(1) << (limits::digits - 1)
+          && binary_exponent > limits::min_exponent;
+      bignum r(f), s(1), m_minus(1), m_plus(1);
+      bignum& high_gap = unequal_gaps ? m_plus : m_minus;
+      r.multiply_pow2(unequal_gaps ? 2 : 1);
+      s.multiply_pow2(unequal_gaps ? 2 : 1);
+      if (e >= 0)
+      {
+          r.multiply_pow2(e);
+          m_minus.multiply_pow2(e);
+          if (unequal_gaps)
+              m_plus.multiply_pow2(e + 1);
+      }
+      else
+      {
+          s.multiply_pow2(-e);
+          if (unequal_gaps)
+              m_plus.multiply_pow2(1);
+      }
+
+      // Round-to-even readers take the boundaries of an even f
+      bool const boundaries = f % 2 == 0;
+
+      if (k >= 0)
+      {
+          s.multiply_pow10(k);
+      }
+      else
+      {
+          r.multiply_pow10(-k);
+          m_minus.multiply_pow10(-k);
+          if (unequal_gaps)
+              m_plus.multiply_pow10(-k);
+      }
+
+      int const fixup = compare_sum(r, high_gap, s);
+      bool const estimate_low = boundaries ? fixup >= 0 : fixup > 0;
+      exponent = k + estimate_low;
+
+      // r / s holds the first digit once scaled by 10 unless the
+      // estimate was low
+      int n = 0;
+      for (bool first = true;; first = false)
+      {
+          if (!first || !estimate_low)
+          {
+              r.multiply(10);
+              m_minus.multiply(10);
+              if (unequal_gaps)
+                  m_plus.multiply(10);
+          }
+          int d = r.divide_digit(s);
+
+          int const low = compare(r, m_minus);
+          int const high = compare_sum(r, high_gap, s);
+          bool const low_done = boundaries ? low <= 0 : low < 0;
+          bool const high_done = boundaries ? high >= 0 : high > 0;
+
+          if (low_done && high_done)
+          {
+              // Either digit reads back as x; take the nearer
+              r.multiply_pow2(1);
+              d += compare(r, s) >= 0;
+          }
+          else if (high_done)
+          {
+              ++d;
+          }
+          out[n++] = char('0' + d);
+          if (low_done || high_done)
+              return n;
+      }
+  }
+
+  // Room for any output of format()
+  std::size_t const max_length = 32;
+
+  // Writes x, which must be finite, in JSON syntax, with the shortest
+  // digits that read back as x, and always with a '.' or an exponent
+  // so that it reads back as a float.  Returns the end of the text.
+  template <class Float>
+  char* format(Float x, char* out)
+  {
+      if (std::signbit(x))
+      {
+          *out++ = '-';
+          x = -x;
+      }
+      if (x == 0)
+      {
+          std::memcpy(out, "0.0", 3);
+          return out + 3;
+      }
+
+      char d[std::numeric_limits<Float>::max_digits10 + 1];
+      int k;
+      int const n = digits(x, d, k);
+
+      if (k > 0 && k <= 21)
+      {
+          // ddd.ddd, or ddd000.0
+          if (n <= k)
+          {
+              std::memcpy(out, d, n);
+              std::memset(out + n, '0', k - n);
+              out += k;
+              std::memcpy(out, ".0", 2);
+              return out + 2;
+          }
+          std::memcpy(out, d, k);
+          out[k] = '.';
+          std::memcpy(out + k + 1, d + k, n - k);
+          return out + n + 1;
+      }
+
+      if (k <= 0 && k > -6)
+      {
+          // 0.000ddd
+          *out++ = '0';
+          *out++ = '.';
+          std::memset(out, '0', -k);
+          out += -k;
+          std::memcpy(out, d, n);
+          return out + n;
+      }
+
+      // d.ddde-nn
+      *out++ = d[0];
+      if (n > 1)
+      {
+          *out++ = '.';
+          std::memcpy(out, d + 1, n - 1);
+          out += n - 1;
+      }
+      *out++ = 'e';
+      int e = k - 1;
+      if (e < 0)
+      {
+          *out++ = '-';
+          e = -e;
+      }
+      char exponent[8];
+      char* p = exponent + sizeof(exponent);
+      do
+      {
+          *--p = char('0' + e % 10);
+          e /= 10;
+      }
+      while (e);
+      std::memcpy(out, p, exponent + sizeof(exponent) - p);
+      return out + (exponent + sizeof(exponent) - p);
+  }
+}
+
+#endif // SHORTEST_FLOAT_DWA2012_HPP
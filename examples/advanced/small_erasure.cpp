@@ -0,0 +1,448 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// erasure.cpp's json_value puts every value, even a bool, in a
+// json_store on the heap, and copies it through a virtual clone().
+// This one keeps any value that fits, and can be moved without
+// throwing, in a buffer inside the json_value, and finds the
+// operations on it through a table of function pointers, one table per
+// stored type.  All the JSON types fit, so a scalar or a short string
+// costs no allocation, and an array of numbers costs one.  Anything
+// bigger still goes to the heap.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_SMALL_ERASURE_TEST
+#endif
+
+#include <boost/move/move.hpp>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/vector.hpp>
+#include <boost/container/string.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/foreach.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/io/ios_state.hpp>
+#include <boost/mpl/if.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/is_nothrow_move_constructible.hpp>
+
+#include "json_escape.hpp"
+
+#include <new>
+#include <string>
+#include <vector>
+#include <ostream>
+
+bool logging = false;
+
+#ifndef NDEBUG
+# include <iostream>
+# define LOG(x) do { if (logging) std::cout << x << std::endl; } while(0)
+#else
+# define LOG(x)
+#endif
+
+struct json_null {};
+
+std::ostream& operator<<(std::ostream& s, json_null const& x)
+{
+    return s << "null";
+}
+
+typedef long double json_float;
+
+#ifndef BOOST_NO_INT64_T
+typedef boost::int64_t json_integer;
+#else
+typedef boost::int32_t json_integer;
+#endif 
+
+struct json_string : boost::container::string
+{
+    typedef boost::container::string rep_t;
+    
+    json_string(char const* p) : rep_t(p) {}
+
+    json_string(rep_t rhs) { rhs.swap(*this); }
+    
+    json_string() {}
+    
+    json_string(json_string const& rhs)
+        : rep_t(rhs)
+    {
+        LOG("json_string copy");
+    }
+
+    template <class Iterator>
+    json_string(Iterator begin, Iterator end)
+        : rep_t(begin, end)
+    {
+    }
+
+    json_string& operator=(BOOST_COPY_ASSIGN_REF(json_string) rhs) // Copy assignment
+    {
+        LOG("json_string copy assign");
+        rep_t::operator=(rhs);
+        return *this;
+    }
+
+    // Move constructor; json_value only keeps types in its buffer if
+    // they can't throw here
+    json_string(BOOST_RV_REF(json_string) rhs) BOOST_NOEXCEPT //Move constructor
+        : rep_t(boost::move(rhs))
+    {
+        LOG("json_string move");
+    }
+
+    json_string& operator=(BOOST_RV_REF(json_string) rhs) //Move assignment
+    {
+        LOG("json_string move assign");
+        rep_t::operator=(boost::move(rhs));
+        return *this;
+    }
+
+ private:
+    BOOST_COPYABLE_AND_MOVABLE(json_string)
+};
+
+inline std::ostream& operator<<(std::ostream& os, json_string const& s)
+{
+    std::string out;
+    json_escape::append_quoted(out, s.data(), s.data() + s.size());
+    return os << out;
+}
+
+struct json_value;
+typedef boost::container::vector<json_value> json_array;
+typedef boost::container::flat_map<json_string, json_value> json_object;
+
+
+// The operations on one stored type
+struct json_ops
+{
+    void (*copy)(void const* from, void* to);
+    void (*relocate)(void* from, void* to);      // move, then destroy from
+    void (*destroy)(void* x);
+    void (*print)(void const* x, std::ostream& os);
+};
+
+namespace small_buffer
+{
+  std::size_t const size = 32;
+  typedef boost::aligned_storage<size, boost::alignment_of<long double>::value> storage;
+
+  template <class T>
+  struct fits
+  {
+      static bool const value = sizeof(T) <= size
+          && boost::alignment_of<long double>::value % boost::alignment_of<T>::value == 0
+          && boost::is_nothrow_move_constructible<T>::value;
+  };
+
+  template <class T>
+  inline void print(std::ostream& os, T const& x)
+  {
+      boost::io::ios_flags_saver ifs( os );
+      os << std::boolalpha << x;
+  }
+
+  // T itself is in the buffer
+  template <class T>
+  struct in_place
+  {
+      static T& get(void* p) { return *static_cast<T*>(p); }
+      static T const& get(void const* p) { return *static_cast<T const*>(p); }
+
+      static void create(T& x, void* to) { new (to) T(boost::move(x)); }
+      static void copy(void const* from, void* to) { new (to) T(get(from)); }
+
+      static void relocate(void* from, void* to)
+      {
+          new (to) T(boost::move(get(from)));
+          get(from).~T();
+      }
+
+      static void destroy(void* x) { get(x).~T(); }
+      static void print(void const* x, std::ostream& os) { small_buffer::print(os, get(x)); }
+
+      static json_ops const ops;
+  };
+
+  template <class T>
+  json_ops const in_place<T>::ops = { &copy, &relocate, &destroy, &print };
+
+  // A pointer to T is in the buffer
+  template <class T>
+  struct on_heap
+  {
+      static T*& get(void* p) { return *static_cast<T**>(p); }
+      static T const* get(void const* p) { return *static_cast<T* const*>(p); }
+
+      static void create(T& x, void* to) { new (to) T*(new T(boost::move(x))); }
+      static void copy(void const* from, void* to) { new (to) T*(new T(*get(from))); }
+      static void relocate(void* from, void* to) { new (to) T*(get(from)); }
+      static void destroy(void* x) { delete get(x); }
+      static void print(void const* x, std::ostream& os) { small_buffer::print(os, *get(x)); }
+
+      static json_ops const ops;
+  };
+
+  template <class T>
+  json_ops const on_heap<T>::ops = { &copy, &relocate, &destroy, &print };
+
+  template <class T>
+  struct policy
+    : boost::mpl::if_c<fits<T>::value, in_place<T>, on_heap<T> >
+  {};
+}
+
+struct json_value
+{
+ public:
+    json_value() { null(); }
+
+    ~json_value() { ops->destroy(buffer.address()); }
+
+    template <class T>
+    json_value(T x)
+    {
+        init(x, boost::is_integral<T>(), boost::is_floating_point<T>());
+    }
+
+    json_value(char const* s)
+    {
+        json_string x(s);
+        create(x);
+    }
+
+    template <class T>
+    json_value& operator=(T x)
+    {
+        json_value v(x);
+        return *this = boost::move(v);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, json_value const& v)
+    {
+        v.ops->print(v.buffer.address(), os);
+        return os;
+    }
+
+    json_value(json_value const& rhs)
+      : ops(rhs.ops)
+    {
+        LOG("json_value copy");
+        ops->copy(rhs.buffer.address(), buffer.address());
+    }
+
+    json_value& operator=(BOOST_COPY_ASSIGN_REF(json_value) rhs) // Copy assignment
+    {
+        LOG("json_value copy assign");
+        json_value copy(rhs);
+        return *this = boost::move(copy);
+    }
+
+    // Move constructor
+    json_value(BOOST_RV_REF(json_value) rhs)            //Move constructor
+      : ops(rhs.ops)
+    {
+        LOG("json_value move");
+        ops->relocate(rhs.buffer.address(), buffer.address());
+        rhs.null();
+    }
+
+    json_value& operator=(BOOST_RV_REF(json_value) rhs) //Move assignment
+    {
+        LOG("json_value move assign");
+        if (this != &rhs) {
+            ops->destroy(buffer.address());
+            ops = rhs.ops;
+            ops->relocate(rhs.buffer.address(), buffer.address());
+            rhs.null();
+        }
+        return *this;
+    }
+
+    friend void swap(json_value& lhs, json_value& rhs)
+    {
+        json_value x(boost::move(lhs));
+        lhs = boost::move(rhs);
+        rhs = boost::move(x);
+    }
+
+ private:
+    BOOST_STATIC_ASSERT(boost::is_integral<bool>::value);
+
+    template <class T>
+    void init(T x, boost::true_type, boost::false_type)
+    {
+        json_integer i(x);
+        create(i);
+    }
+
+    void init(bool x, boost::true_type, boost::false_type)
+    {
+        create(x);
+    }
+
+    template <class T>
+    void init(T x, boost::false_type, boost::true_type)
+    {
+        json_float f(x);
+        create(f);
+    }
+
+    template <class T>
+    void init(T& x, boost::false_type, boost::false_type)
+    {
+        create(x);
+    }
+
+    // Adopt x's value
+    template <class T>
+    void create(T& x)
+    {
+        typedef typename small_buffer::policy<T>::type policy;
+        policy::create(x, buffer.address());
+        ops = &policy::ops;
+    }
+
+    // What a default-constructed or moved-from json_value holds
+    void null()
+    {
+        json_null x;
+        create(x);
+    }
+
+    BOOST_COPYABLE_AND_MOVABLE(json_value)
+    json_ops const* ops;
+    small_buffer::storage buffer;
+};
+
+inline std::ostream& operator<<(std::ostream& s, json_array const& a)
+{
+    char const* separator = " ";
+    s << "[";
+    BOOST_FOREACH(json_value const& v, a)
+    {
+        s << separator << v;
+        separator = ", ";
+    }
+    s << " ]";
+    return s;
+}
+
+inline std::ostream& operator<<(std::ostream& s, json_object const& o)
+{
+    char const* separator = " ";
+    s << "{";
+    BOOST_FOREACH(json_object::value_type const& v, o)
+    {
+        s << separator << v.first << " : " << v.second;
+        separator = ", ";
+    }
+    s << " }";
+    return s;
+}
+
+// ------------ test driver --------------
+
+#ifdef BUILD_SMALL_ERASURE_TEST
+#include "alloc_count.hpp"
+#include <iostream>
+#include <sstream>
+
+// Too big for the buffer
+struct big
+{
+    big() { std::fill(text, text + sizeof(text), 'x'); text[sizeof(text) - 1] = 0; }
+    char text[64];
+};
+
+std::ostream& operator<<(std::ostream& os, big const& b)
+{
+    return os << b.text;
+}
+
+template <class T>
+std::string printed(T const& x)
+{
+    std::ostringstream s;
+    s << x;
+    return s.str();
+}
+
+int main()
+{
+    BOOST_STATIC_ASSERT(small_buffer::fits<json_string>::value);
+    BOOST_STATIC_ASSERT(small_buffer::fits<json_array>::value);
+    BOOST_STATIC_ASSERT(small_buffer::fits<json_object>::value);
+    BOOST_STATIC_ASSERT(!small_buffer::fits<big>::value);
+
+    // Scalars and short strings are never allocated
+    std::size_t allocations = counting::allocations;
+    {
+        json_value v = json_string("foo bar");
+        std::cout << v << std::endl << std::flush;
+        json_value copies[] = { v, json_value(1), json_value(42.7), json_value(true), json_value() };
+        v = copies[1];
+        swap(v, copies[2]);
+        assert(printed(v) == "42.7" && printed(copies[2]) == "1");
+        assert(printed(copies[4]) == "null");
+    }
+    assert(counting::allocations == allocations);
+    assert(printed(json_value(json_string("a/\"\\\n\x01"))) == "\"a/\\\"\\\\\\n\\u0001\"");
+
+    json_array a;
+    a.push_back(false);
+    a.push_back(1);
+    a.push_back(42.7);
+    a.push_back("b\"a\"z");
+    std::cout << "---------------------------" << std::endl;
+    std::cout << a << std::endl;
+
+    json_object o;
+    o["foo"] = 1;
+    o["bar"] = "baz";
+    o["xxx"] = 3.14;
+    o["lick"] = a;
+    o["pork"] = true;
+    std::cout << o << std::endl;
+
+    // One allocation for an array of numbers, however long
+    json_array numbers;
+    numbers.reserve(1000);
+    for (int i = 0; i < 1000; ++i)
+        numbers.push_back(i * 0.5);
+    allocations = counting::allocations;
+    json_value n1 = numbers;
+    assert(counting::allocations == allocations + 1);
+    json_value moved(boost::move(n1));
+    assert(counting::allocations == allocations + 1);
+    assert(printed(moved) == printed(numbers) && printed(n1) == "null");
+
+    // Deep copies stay independent
+    json_value copy = o;
+    o["foo"] = 2;
+    assert(printed(copy) != printed(o));
+    copy = o;
+    assert(printed(copy) == printed(o));
+
+    // Anything else goes to the heap
+    allocations = counting::allocations;
+    json_value b = big();
+    json_value b2 = b;
+    assert(counting::allocations == allocations + 2);
+    assert(printed(b2) == big().text);
+    b2 = json_value(1);
+    assert(printed(b2) == "1");
+}
+#endif
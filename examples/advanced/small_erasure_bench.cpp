@@ -0,0 +1,17 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over small_erasure.cpp's json_value, which keeps small
+// values in a buffer of its own and the rest on the heap
+//
+//   ./small_erasure_bench [values]
+
+#define NO_TEST
+#include "small_erasure.cpp"
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("erasure + small buffer", argc, argv);
+}
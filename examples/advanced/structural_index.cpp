@@ -0,0 +1,432 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// An optional first pass over JSON text, in the style of simdjson:
+// classify 64 bytes at a time with SSE2 (or AVX2 when compiled with
+// -mavx2), mask out string interiors, and record the offset of every
+// token's first byte.  The parser then walks that index instead of
+// lexing byte by byte.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_STRUCTURAL_INDEX_TEST
+#endif
+
+#include "tokenize.cpp"
+#include <boost/cstdint.hpp>
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+namespace simd
+{
+  // One bit per byte of a 64-byte block
+  struct block_masks
+  {
+      boost::uint64_t quote, backslash, structural, space, control;
+  };
+
+#if defined(__AVX2__)
+  inline boost::uint32_t eq(__m256i x, char c)
+  {
+      return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(c)));
+  }
+
+  inline void classify32(char const* p, boost::uint32_t* m)
+  {
+      __m256i const x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+      m[0] = eq(x, '"');
+      m[1] = eq(x, '\\');
+      m[2] = eq(x, '[') | eq(x, ']') | eq(x, '{') | eq(x, '}') | eq(x, ':') | eq(x, ',');
+      m[3] = eq(x, ' ') | eq(x, '\t') | eq(x, '\n') | eq(x, '\r');
+      m[4] = _mm256_movemask_epi8(   // x <= 0x1F, unsigned
+          _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(0x1F)), x));
+  }
+
+  inline void classify(char const* p, block_masks& b)
+  {
+      boost::uint32_t lo[5], hi[5];
+      classify32(p, lo);
+      classify32(p + 32, hi);
+      boost::uint64_t* const out = &b.quote;
+      for (int i = 0; i < 5; ++i)
+          out[i] = lo[i] | boost::uint64_t(hi[i]) << 32;
+  }
+#elif defined(__SSE2__)
+  inline boost::uint64_t eq(__m128i x, char c)
+  {
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c)));
+  }
+
+  inline void classify(char const* p, block_masks& b)
+  {
+      b.quote = b.backslash = b.structural = b.space = b.control = 0;
+      for (int i = 0; i < 4; ++i)
+      {
+          __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16 * i));
+          int const shift = 16 * i;
+          b.quote |= eq(x, '"') << shift;
+          b.backslash |= eq(x, '\\') << shift;
+          b.structural |= (eq(x, '[') | eq(x, ']') | eq(x, '{') | eq(x, '}')
+                           | eq(x, ':') | eq(x, ',')) << shift;
+          b.space |= (eq(x, ' ') | eq(x, '\t') | eq(x, '\n') | eq(x, '\r')) << shift;
+          b.control |= boost::uint64_t(_mm_movemask_epi8(   // x <= 0x1F, unsigned
+              _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1F)), x))) << shift;
+      }
+  }
+#else
+  // Portable fallback, so the index can be tested anywhere
+  inline void classify(char const* p, block_masks& b)
+  {
+      b.quote = b.backslash = b.structural = b.space = b.control = 0;
+      for (int i = 0; i < 64; ++i)
+      {
+          unsigned char const c = p[i];
+          boost::uint64_t const bit = boost::uint64_t(1) << i;
+          if (c == '"') b.quote |= bit;
+          if (c == '\\') b.backslash |= bit;
+          if (lex::flags[c] & lex::structural) b.structural |= bit;
+          if (c == ' ' || c == '\t' || c == '\n' || c == '\r') b.space |= bit;
+          if (c < 0x20) b.control |= bit;
+      }
+  }
+#endif
+
+  // The first backslash in [first, last), or last
+  inline char const* find_backslash(char const* first, char const* last)
+  {
+#if defined(__SSE2__)
+      __m128i const backslash = _mm_set1_epi8('\\');
+      for (; last - first >= 16; first += 16)
+      {
+          int const m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+              _mm_loadu_si128(reinterpret_cast<__m128i const*>(first)), backslash));
+          if (m)
+              return first + __builtin_ctz(m);
+      }
+#endif
+      while (first != last && *first != '\\')
+          ++first;
+      return first;
+  }
+
+  // Bit i of the result is the xor of bits 0..i of x
+  inline boost::uint64_t prefix_xor(boost::uint64_t x)
+  {
+      x ^= x << 1;
+      x ^= x << 2;
+      x ^= x << 4;
+      x ^= x << 8;
+      x ^= x << 16;
+      x ^= x << 32;
+      return x;
+  }
+
+  // Marks the bytes escaped by an odd-length run of backslashes.
+  // carry is 1 iff the previous block ended in such a run.
+  inline boost::uint64_t escaped(boost::uint64_t backslash, boost::uint64_t& carry)
+  {
+      boost::uint64_t const even_bits = 0x5555555555555555ULL;
+      boost::uint64_t const odd_bits = ~even_bits;
+
+      // A run carried in from the previous block flips the parity at bit 0
+      boost::uint64_t const starts = backslash & ~(backslash << 1);
+      boost::uint64_t const even_start_mask = even_bits ^ carry;
+      boost::uint64_t const even_starts = starts & even_start_mask;
+      boost::uint64_t const odd_starts = starts & ~even_start_mask;
+
+      boost::uint64_t const even_carries = backslash + even_starts;
+      boost::uint64_t odd_carries = backslash + odd_starts;
+      bool const overflow = odd_carries < backslash;
+      odd_carries |= carry;
+
+      boost::uint64_t const even_ends = even_carries & ~backslash & odd_bits;
+      boost::uint64_t const odd_ends = odd_carries & ~backslash & even_bits;
+
+      carry = overflow;
+      return even_ends | odd_ends;
+  }
+}
+
+// Offsets of the first byte of every token in a JSON text
+class structural_index
+{
+ public:
+    typedef boost::uint32_t offset;
+
+    structural_index(char const* first, char const* last)
+      : first(first), last(last)
+    {
+        if (std::size_t(last - first) >= 0xFFFFFFFFu)
+            throw std::length_error("structural_index: input exceeds 4GB");
+        build();
+    }
+
+    char const* begin() const { return first; }
+    char const* end() const { return last; }
+
+    std::vector<offset> const& offsets() const { return index; }
+
+ private:
+    void build()
+    {
+        // Typical JSON has a token every eight bytes or so; append()
+        // grows the index if this guess is short
+        count = 0;
+        index.resize((last - first) / 8 + 64);
+
+        boost::uint64_t odd_backslash = 0;   // carries between blocks
+        boost::uint64_t in_string = 0;
+        boost::uint64_t after_separator = 1;
+        boost::uint64_t after_close = 0;
+
+        std::size_t base = 0;
+        std::size_t const size = last - first;
+        for (; base < size; base += 64)
+        {
+            simd::block_masks b;
+            if (size - base >= 64)
+            {
+                simd::classify(first + base, b);
+            }
+            else
+            {
+                char tail[64];
+                std::memset(tail, ' ', sizeof(tail));
+                std::memcpy(tail, first + base, size - base);
+                simd::classify(tail, b);
+            }
+
+            boost::uint64_t const quotes = b.quote & ~simd::escaped(b.backslash, odd_backslash);
+
+            // Opening quotes and string interiors; closing quotes are excluded
+            boost::uint64_t const strings = simd::prefix_xor(quotes) ^ in_string;
+            in_string = boost::uint64_t(boost::int64_t(strings) >> 63);
+
+            boost::uint64_t const structurals = b.structural & ~strings;
+            boost::uint64_t const separators = structurals | b.space & ~strings;
+            boost::uint64_t const closes = quotes & ~strings;
+
+            // Scalars start after a separator; a string starts at its open quote
+            boost::uint64_t const atoms = ~(separators | strings | closes);
+            boost::uint64_t const starts = structurals | quotes & strings
+                | atoms & (separators << 1 | after_separator);
+
+            // Control characters in strings, and junk glued to a closing quote
+            boost::uint64_t const errors = b.control & strings
+                | (closes << 1 | after_close) & ~(separators | strings);
+
+            after_separator = separators >> 63;
+            after_close = closes >> 63;
+
+            if (errors)
+                fail(base + __builtin_ctzll(errors));
+
+            append(base, starts & (size - base >= 64 ? ~0ULL : (1ULL << (size - base)) - 1));
+        }
+
+        index.resize(count);
+        if (in_string)
+            fail(size);
+    }
+
+    // Writes in batches of four past the last set bit, so index keeps
+    // enough slack for a whole block
+    void append(std::size_t base, boost::uint64_t bits)
+    {
+        if (index.size() - count < 64)
+            index.resize(2 * index.size());
+
+        offset* out = &index[count];
+        count += __builtin_popcountll(bits);
+        while (bits)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = offset(base + __builtin_ctzll(bits | 1ULL << 63));
+                bits &= bits - 1;
+            }
+            out += 4;
+        }
+    }
+
+    void fail(std::size_t where) const
+    {
+        throw json_lex_error(where);
+    }
+
+    char const* first;
+    char const* last;
+    std::vector<offset> index;
+    std::size_t count;   // entries of index in use while building
+};
+
+// Yields the same token spans as json_token_iterator by walking a
+// structural_index.  Whitespace and structural characters were handled
+// by the index pass; scalars are still checked by the scalar lexer,
+// which is cheap because they are short, and strings only when they
+// contain an escape.
+class indexed_token_iterator
+  : public boost::iterator_facade<
+        indexed_token_iterator, token const, boost::forward_traversal_tag>
+{
+ public:
+    // The end iterator
+    indexed_token_iterator()
+      : idx(0), pos(0)
+    {}
+
+    explicit indexed_token_iterator(structural_index const& idx)
+      : idx(&idx), pos(0)
+    {
+        increment();
+    }
+
+ private:
+    friend class boost::iterator_core_access;
+
+    token const& dereference() const { return current; }
+
+    bool equal(indexed_token_iterator const& rhs) const
+    {
+        return current.first == rhs.current.first;
+    }
+
+    void increment()
+    {
+        std::vector<structural_index::offset> const& offsets = idx->offsets();
+        if (pos == offsets.size())
+        {
+            current = token();
+            return;
+        }
+
+        char const* const text = idx->begin();
+        char const* const first = text + offsets[pos];
+        char const* last = first + 1;
+        ++pos;
+
+        if (!(lex::flags[(unsigned char)*first] & lex::structural))
+        {
+            last = pos == offsets.size() ? idx->end() : text + offsets[pos];
+            while (lex::flags[(unsigned char)last[-1]] & lex::space)
+                --last;
+
+            if (*first != '"' || std::memchr(first, '\\', last - first))
+                check(text, first, last);
+        }
+        current = token(first, last, true);
+    }
+
+    // Make sure the scalar lexer sees exactly one token in [first, last)
+    static void check(char const* text, char const* first, char const* last)
+    {
+        try
+        {
+            json_token_iterator const t(first, last);
+            if (t->second != last)
+                throw json_lex_error(t->second - first);
+        }
+        catch(json_lex_error const& e)
+        {
+            throw json_lex_error(first - text + e.offset);
+        }
+    }
+
+    structural_index const* idx;
+    std::size_t pos;
+    token current;
+};
+
+inline indexed_token_iterator tokens(structural_index const& idx)
+{
+    return indexed_token_iterator(idx);
+}
+
+#ifdef BUILD_STRUCTURAL_INDEX_TEST
+# include <cstdlib>
+
+// The index and the scalar lexer must agree token for token
+void check_same_tokens(char const* first, char const* last)
+{
+    structural_index idx(first, last);
+    token_iterator t = tokens(first, last);
+    BOOST_FOREACH(token i, std::make_pair(tokens(idx), indexed_token_iterator()))
+    {
+        assert(t != token_iterator() && *t == i);
+        ++t;
+    }
+    assert(t == token_iterator());
+}
+
+void check_same_tokens(std::string const& s)
+{
+    check_same_tokens(s.data(), s.data() + s.size());
+}
+
+// Returns the error offset the index reports for s, or -1
+long index_error(std::string const& s)
+{
+    try
+    {
+        structural_index idx(s.data(), s.data() + s.size());
+        for (indexed_token_iterator i = tokens(idx); i != indexed_token_iterator(); ++i)
+            ;
+    }
+    catch(json_lex_error const& e)
+    {
+        return e.offset;
+    }
+    return -1;
+}
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    check_same_tokens(input.begin(), input.end());
+
+    // Escapes and quotes straddling block boundaries
+    std::string s = "[";
+    for (int i = 0; i < 200; ++i)
+    {
+        s += std::string(i % 70, ' ') + "\"" + std::string(i % 5, '\\') + std::string(i % 5, '\\')
+            + "\\\"x" + std::string(i % 67, 'y') + "\" , " + "-12.5e3,true,{\"k\\\\\":null}";
+        s += i == 199 ? "]" : ",";
+    }
+    check_same_tokens(s);
+    check_same_tokens("");
+    check_same_tokens("   42   ");
+
+    // Randomly generated backslash/quote soup inside valid strings
+    std::srand(42);
+    for (int n = 0; n < 1000; ++n)
+    {
+        std::string t = "[";
+        for (int i = 0, len = std::rand() % 40; i < len; ++i)
+        {
+            t += "\"";
+            for (int j = 0, k = std::rand() % 10; j < k; ++j)
+                t += (std::rand() % 2) ? "\\\\" : (std::rand() % 2) ? "\\\"" : "a";
+            t += "\",";
+        }
+        t += "0]";
+        check_same_tokens(t);
+    }
+
+    assert(index_error("[1, tru]") == 4);
+    assert(index_error("[\"abc]") == 6);
+    assert(index_error("[\"a\nb\"]") == 3);
+    assert(index_error("[\"a\"b]") == 4);
+    assert(index_error("[\"a\\q\"]") == 4);
+    assert(index_error("[1.]") == 3);
+}
+#endif
@@ -1,41 +1,138 @@
 // Copyright Dave Abrahams 2012. Distributed under the Boost
 // Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TOKENIZE_DWA20121126_CPP
+# define TOKENIZE_DWA20121126_CPP
+
 #include <boost/xpressive/xpressive.hpp>
 #include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/lexical_cast.hpp>
 #include <iostream>
-#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-std::string load_file(char const* file)
+// A read-only view of a file's bytes.  Regular files are mapped into
+// memory so nothing is copied; anything that can't be mapped (pipes,
+// terminals, /dev/stdin) is read in large blocks into a buffer.
+class file_source : boost::noncopyable
 {
-    std::ifstream is(file);
-    std::string s;
-    s.erase();
-    //
-    // attempt to grow string buffer to match file size,
-    // this doesn't always work...
-    s.reserve(is.rdbuf()->in_avail());
-    char c;
-    while(is.get(c))
+ public:
+    typedef char const* iterator;
+    typedef char const* const_iterator;
+
+    explicit file_source(char const* path)
+      : data(0), length(0), mapped(false)
+    {
+        int const fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            fail("open", path, errno);
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void* p = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<char const*>(p);
+                length = st.st_size;
+                mapped = true;
+            }
+        }
+
+        int const error = mapped ? 0 : read_all(fd);
+        ::close(fd);
+        if (error)
+            fail("read", path, error);
+    }
+
+    ~file_source()
     {
-        // use logarithmic growth stategy, in case
-        // in_avail (above) returned zero:
-        if(s.capacity() == s.size())
-            s.reserve(s.capacity() * 3);
-        s.append(1, c);
+        if (mapped)
+            ::munmap(const_cast<char*>(data), length);
     }
-    return s;
+
+    char const* begin() const { return data; }
+    char const* end() const { return data + length; }
+    std::size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    // true iff the contents are mapped rather than buffered
+    bool is_mapped() const { return mapped; }
+
+ private:
+    // Returns 0 or an errno value
+    int read_all(int fd)
+    {
+        std::size_t const block = 64 * 1024;
+        std::size_t used = 0;
+        for (;;)
+        {
+            if (buffer.size() - used < block)
+                buffer.resize(std::max(2 * buffer.size(), used + block));
+
+            ssize_t const n = ::read(fd, &buffer[used], buffer.size() - used);
+            if (n == 0)
+                break;
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno;
+            }
+            used += n;
+        }
+        buffer.resize(used);
+        data = used ? &buffer[0] : 0;
+        length = used;
+        return 0;
+    }
+
+    static void fail(char const* what, char const* path, int error)
+    {
+        throw std::runtime_error(
+            std::string(what) + " " + path + ": " + std::strerror(error));
+    }
+
+    char const* data;
+    std::size_t length;
+    bool mapped;
+    std::vector<char> buffer;
+};
+
+// Convenience for callers that really want their own copy
+std::string load_file(char const* file)
+{
+    file_source f(file);
+    return std::string(f.begin(), f.end());
 }
 
 namespace xpr = boost::xpressive;
 
-typedef xpr::sregex_token_iterator token_iterator;
-typedef token_iterator::value_type token;
+typedef xpr::csub_match token;
 
-inline token_iterator tokens(std::string const& s)
+//
+// The original tokenizer: one regex search per token.  Kept for
+// comparison; see lex_bench.cpp.
+//
+typedef xpr::cregex_token_iterator regex_token_iterator;
+
+inline regex_token_iterator regex_tokens(char const* first, char const* last)
 {
-    static xpr::sregex token_pattern = xpr::sregex::compile(
+    static xpr::cregex token_pattern = xpr::cregex::compile(
       "(?:\\s*)("
         // single characters
         "[[\\]{}:,]"
@@ -49,21 +146,292 @@ inline token_iterator tokens(std::string const& s)
           "|" "[^" "\\\\" "\"" "]"
         ")*\""
         "|" // numbers
-        "-?(?:0|[1-9][0-9]*(?:[.][0-9]+)?(?:[eE][+-]?[0-9]+)?)"
+        "-?(?:0|[1-9][0-9]*)(?:[.][0-9]+)?(?:[eE][+-]?[0-9]+)?"
       ")");
 
-    return token_iterator(s.begin(), s.end(), token_pattern, 1);
+    return regex_token_iterator(first, last, token_pattern, 1);
+}
+
+//
+// The table-driven tokenizer.  Each byte is classified with a single
+// table lookup, and numbers are recognized by a small DFA, so no
+// input character is ever examined twice.
+//
+struct json_lex_error : std::runtime_error
+{
+    json_lex_error(std::size_t offset)
+      : std::runtime_error("invalid JSON token at offset "
+                           + boost::lexical_cast<std::string>(offset)),
+        offset(offset)
+    {}
+
+    std::size_t offset;
+};
+
+namespace lex
+{
+  enum
+  {
+      space = 1,        // insignificant whitespace
+      structural = 2,   // one of [ ] { } : ,
+      string_stop = 4,  // ends the fast path through a string body
+      hex = 8,          // may appear in \uXXXX
+      digit = 16        // 0-9
+  };
+
+  static unsigned char const flags[256] = {
+     4,  4,  4,  4,  4,  4,  4,  4,  4,  5,  5,  4,  4,  5,  4,  4,
+     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+     1,  0,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,
+    24, 24, 24, 24, 24, 24, 24, 24, 24, 24,  2,  0,  0,  0,  0,  0,
+     0,  8,  8,  8,  8,  8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  4,  2,  0,  0,
+     0,  8,  8,  8,  8,  8,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  2,  0,  0,
+      // bytes >= 0x80 are all 0
+  };
+
+  // Character classes and states of the number recognizer
+  enum { n_other, n_minus, n_zero, n_digit, n_dot, n_exp, n_plus, n_classes };
+  enum { s_start, s_minus, s_zero, s_int, s_dot, s_frac, s_e, s_esign, s_exp, s_reject };
+
+  inline int number_class(unsigned char c)
+  {
+      if (flags[c] & digit)
+          return c == '0' ? n_zero : n_digit;
+      switch (c)
+      {
+      case '-': return n_minus;
+      case '+': return n_plus;
+      case '.': return n_dot;
+      case 'e': case 'E': return n_exp;
+      default: return n_other;
+      }
+  }
+
+  static unsigned char const number_transitions[s_reject][n_classes] = {
+      //           other     minus     zero      digit     dot       exp       plus
+      /* start */ {s_reject, s_minus,  s_zero,   s_int,    s_reject, s_reject, s_reject},
+      /* minus */ {s_reject, s_reject, s_zero,   s_int,    s_reject, s_reject, s_reject},
+      /* zero  */ {s_reject, s_reject, s_reject, s_reject, s_dot,    s_e,      s_reject},
+      /* int   */ {s_reject, s_reject, s_int,    s_int,    s_dot,    s_e,      s_reject},
+      /* dot   */ {s_reject, s_reject, s_frac,   s_frac,   s_reject, s_reject, s_reject},
+      /* frac  */ {s_reject, s_reject, s_frac,   s_frac,   s_reject, s_e,      s_reject},
+      /* e     */ {s_reject, s_esign,  s_exp,    s_exp,    s_reject, s_reject, s_esign },
+      /* esign */ {s_reject, s_reject, s_exp,    s_exp,    s_reject, s_reject, s_reject},
+      /* exp   */ {s_reject, s_reject, s_exp,    s_exp,    s_reject, s_reject, s_reject}
+  };
+
+  inline bool accepts_number(int state)
+  {
+      return state == s_zero || state == s_int || state == s_frac || state == s_exp;
+  }
+
+  //
+  // Each scanner starts at the first byte of a token and advances pos
+  // just past it.  On malformed input it returns false, leaving pos at
+  // the offending byte.  Nothing throws or allocates.
+  //
+  inline bool scan_string(char const*& pos, char const* last)
+  {
+      ++pos;
+      for (;;)
+      {
+          while (pos != last && !(flags[(unsigned char)*pos] & string_stop))
+              ++pos;
+
+          if (pos == last)
+              return false;
+          if (*pos == '"')
+              break;
+          if (*pos != '\\')               // unescaped control character
+              return false;
+
+          if (++pos == last)
+              return false;
+          switch (*pos)
+          {
+          case '"': case '\\': case '/':
+          case 'b': case 'f': case 'n': case 'r': case 't':
+              ++pos;
+              break;
+          case 'u':
+              if (last - pos < 5)
+                  return false;
+              for (int i = 1; i <= 4; ++i)
+              {
+                  if (!(flags[(unsigned char)pos[i]] & hex))
+                  {
+                      pos += i;
+                      return false;
+                  }
+              }
+              pos += 5;
+              break;
+          default:
+              return false;
+          }
+      }
+      ++pos;
+      return true;
+  }
+
+  inline bool scan_literal(char const*& pos, char const* last, char const* text, std::size_t n)
+  {
+      if (std::size_t(last - pos) < n || std::memcmp(pos, text, n) != 0)
+          return false;
+      pos += n;
+      return true;
+  }
+
+  inline bool scan_number(char const*& pos, char const* last)
+  {
+      int state = s_start;
+      for (; pos != last; ++pos)
+      {
+          int const next = number_transitions[state][number_class(*pos)];
+          if (next == s_reject)
+              break;
+          state = next;
+      }
+      return accepts_number(state);
+  }
+
+  // Any one token; pos must be at neither whitespace nor last
+  inline bool scan_token(char const*& pos, char const* last)
+  {
+      switch (*pos)
+      {
+      case '"':
+          return scan_string(pos, last);
+      case 't':
+          return scan_literal(pos, last, "true", 4);
+      case 'f':
+          return scan_literal(pos, last, "false", 5);
+      case 'n':
+          return scan_literal(pos, last, "null", 4);
+      default:
+          if (flags[(unsigned char)*pos] & structural)
+          {
+              ++pos;
+              return true;
+          }
+          return scan_number(pos, last);
+      }
+  }
+}
+
+class json_token_iterator
+  : public boost::iterator_facade<
+        json_token_iterator, token const, boost::forward_traversal_tag>
+{
+ public:
+    // The end iterator
+    json_token_iterator()
+      : start(0), pos(0), last(0)
+    {}
+
+    json_token_iterator(char const* first, char const* last)
+      : start(first), pos(first), last(last)
+    {
+        increment();
+    }
+
+ private:
+    friend class boost::iterator_core_access;
+
+    token const& dereference() const { return current; }
+
+    bool equal(json_token_iterator const& rhs) const
+    {
+        return current.first == rhs.current.first;
+    }
+
+    void increment()
+    {
+        while (pos != last && (lex::flags[(unsigned char)*pos] & lex::space))
+            ++pos;
+
+        if (pos == last)
+        {
+            current = token();
+            return;
+        }
+
+        char const* const first = pos;
+        if (!lex::scan_token(pos, last))
+            error();
+        current = token(first, pos, true);
+    }
+
+    void error() const
+    {
+        throw json_lex_error(pos - start);
+    }
+
+    char const* start;  // beginning of the input, for error offsets
+    char const* pos;    // just past the current token
+    char const* last;
+    token current;
+};
+
+typedef json_token_iterator token_iterator;
+
+inline token_iterator tokens(char const* first, char const* last)
+{
+    return token_iterator(first, last);
+}
+
+inline token_iterator tokens(std::string const& s)
+{
+    return tokens(s.data(), s.data() + s.size());
+}
+
+// Tokenize a file in place, without copying it into a string
+inline token_iterator tokens(file_source const& f)
+{
+    return tokens(f.begin(), f.end());
 }
 
 #ifndef NO_TEST
-int main()
+int main(int const argc, char const* argv[])
 {
     try
     {
-        std::string input = load_file("test.json");
+        // Try "./tokenize /dev/stdin < test.json" for the unmapped path
+        file_source input(argc > 1 ? argv[1] : "test.json");
 
+        // Both tokenizers must agree on well-formed input
+        regex_token_iterator r = regex_tokens(input.begin(), input.end());
         BOOST_FOREACH(token t, std::make_pair(tokens(input),token_iterator()))
+        {
+            assert(r != regex_token_iterator() && *r == t);
+            ++r;
             std::cout << t << std::endl;
+        }
+        assert(r == regex_token_iterator());
+
+        char const number_text[] = "[0.5,-0,1e5,2E-3,-12.25e+2]";
+        token_iterator n = tokens(number_text, number_text + sizeof(number_text) - 1);
+        for (r = regex_tokens(number_text, number_text + sizeof(number_text) - 1);
+             r != regex_token_iterator(); ++r, ++n)
+        {
+            assert(*n == *r);
+        }
+        assert(n == token_iterator());
+
+        char const bad[] = "[1, tru]";
+        try
+        {
+            token_iterator t = tokens(bad, bad + sizeof(bad) - 1);
+            while (t != token_iterator())
+                ++t;
+            assert(!"bad token not detected");
+        }
+        catch(json_lex_error const& e)
+        {
+            assert(e.offset == 4);
+        }
     }
     catch(std::exception const& e)
     {
@@ -72,3 +440,5 @@ int main()
     }
 }
 #endif 
+
+#endif // TOKENIZE_DWA20121126_CPP
@@ -0,0 +1,208 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+//
+// Checks that a text is one well-formed JSON value without building
+// anything.  The lexer's scanners check strings, escapes and numbers;
+// the grammar is a small state machine whose container stack is a
+// fixed bit array, so validation never touches the heap and never
+// throws.
+//
+
+#ifndef NO_TEST
+# define NO_TEST
+# define BUILD_VALIDATE_TEST
+#endif
+
+#include "tokenize.cpp"
+#include <boost/cstdint.hpp>
+
+enum json_status
+{
+    json_valid,
+    json_bad_token,         // malformed string, number or literal
+    json_unexpected_token,  // well-formed token in the wrong place
+    json_incomplete,        // input ended inside a value
+    json_too_deep           // nesting exceeds json_max_depth
+};
+
+std::size_t const json_max_depth = 4096;
+
+struct json_validation
+{
+    json_status status;
+    std::size_t offset;     // of the offending byte, or the input size
+
+    // true iff the text was valid
+    operator bool() const { return status == json_valid; }
+};
+
+inline json_validation validate_json(char const* const first, char const* const last)
+{
+    enum { value_expected, value_or_end, key_expected, key_or_end,
+           colon_expected, comma_or_end, done } state = value_expected;
+
+    // One bit per open container: set for objects
+    boost::uint64_t objects[json_max_depth / 64];
+    std::size_t depth = 0;
+
+    char const* pos = first;
+    for (;;)
+    {
+        while (pos != last && (lex::flags[(unsigned char)*pos] & lex::space))
+            ++pos;
+
+        json_validation result = { json_valid, std::size_t(pos - first) };
+        if (pos == last)
+        {
+            if (state != done)
+                result.status = json_incomplete;
+            return result;
+        }
+
+        char const c = *pos;
+        bool const is_object = depth && objects[(depth - 1) / 64] >> (depth - 1) % 64 & 1;
+
+        switch (state)
+        {
+        case comma_or_end:
+            if (c == ',')
+            {
+                state = is_object ? key_expected : value_expected;
+                ++pos;
+                continue;
+            }
+            if (c != (is_object ? '}' : ']'))
+            {
+                result.status = json_unexpected_token;
+                return result;
+            }
+            // fall through
+        case value_or_end:
+        case key_or_end:
+            if (c == ']' && state != key_or_end || c == '}' && state != value_or_end)
+            {
+                --depth;
+                state = depth ? comma_or_end : done;
+                ++pos;
+                continue;
+            }
+            if (state == key_or_end)
+                goto key;
+            // fall through
+        case value_expected:
+            if (c == '[' || c == '{')
+            {
+                if (depth == json_max_depth)
+                {
+                    result.status = json_too_deep;
+                    return result;
+                }
+                boost::uint64_t& word = objects[depth / 64];
+                boost::uint64_t const bit = boost::uint64_t(1) << depth % 64;
+                word = c == '{' ? word | bit : word & ~bit;
+                ++depth;
+                state = c == '{' ? key_or_end : value_or_end;
+                ++pos;
+                continue;
+            }
+            if (lex::flags[(unsigned char)c] & lex::structural)
+            {
+                result.status = json_unexpected_token;
+                return result;
+            }
+            if (!lex::scan_token(pos, last))
+            {
+                result.status = pos == last ? json_incomplete : json_bad_token;
+                result.offset = pos - first;
+                return result;
+            }
+            state = depth ? comma_or_end : done;
+            continue;
+
+        case key_expected:
+        key:
+            if (c != '"')
+            {
+                result.status = json_unexpected_token;
+                return result;
+            }
+            if (!lex::scan_string(pos, last))
+            {
+                result.status = pos == last ? json_incomplete : json_bad_token;
+                result.offset = pos - first;
+                return result;
+            }
+            state = colon_expected;
+            continue;
+
+        case colon_expected:
+            if (c != ':')
+            {
+                result.status = json_unexpected_token;
+                return result;
+            }
+            state = value_expected;
+            ++pos;
+            continue;
+
+        default:    // done: only whitespace may follow
+            result.status = json_unexpected_token;
+            return result;
+        }
+    }
+}
+
+inline json_validation validate_json(std::string const& s)
+{
+    return validate_json(s.data(), s.data() + s.size());
+}
+
+#ifdef BUILD_VALIDATE_TEST
+# include <iostream>
+
+void check(std::string const& s, json_status status, std::size_t offset)
+{
+    json_validation const r = validate_json(s);
+    if (r.status != status || r.offset != offset)
+    {
+        std::cout << s << ": status " << r.status << " at " << r.offset << std::endl;
+        assert(!"unexpected validation result");
+    }
+}
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    json_validation const r = validate_json(input.begin(), input.end());
+    std::cout << (r ? "valid" : "invalid") << std::endl;
+    assert(r);
+
+    check(" [ 1, -0.5e3, \"a\\u00e9\\n\", {\"k\": [true, false, null]}, {}, [] ] ",
+          json_valid, 64);
+    check("\"just a string\"", json_valid, 15);
+    check("", json_incomplete, 0);
+    check("[1, tru]", json_bad_token, 4);
+    check("[\"a\\q\"]", json_bad_token, 4);
+    check("[\"a\nb\"]", json_bad_token, 3);
+    check("[01]", json_unexpected_token, 2);
+    check("[1.]", json_bad_token, 3);
+    check("[1 2]", json_unexpected_token, 3);
+    check("[1,]", json_unexpected_token, 3);
+    check("[1}", json_unexpected_token, 2);
+    check("{\"a\" 1}", json_unexpected_token, 5);
+    check("{\"a\":1,}", json_unexpected_token, 7);
+    check("{1:2}", json_unexpected_token, 1);
+    check("{\"a\"]", json_unexpected_token, 4);
+    check("[", json_incomplete, 1);
+    check("[\"abc", json_incomplete, 5);
+    check("{\"a\":", json_incomplete, 5);
+    check("1 2", json_unexpected_token, 2);
+    check("]", json_unexpected_token, 0);
+
+    std::string deep(json_max_depth, '[');
+    check(deep + std::string(json_max_depth, ']'), json_valid, 2 * json_max_depth);
+    check(deep + "[", json_too_deep, json_max_depth);
+}
+#endif
@@ -0,0 +1,61 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares validate_json() with a full parse_json_value(), including
+// destruction of the tree it builds.
+//
+//   ./validate_bench [size [file]]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "validate.cpp"
+#include "bench.hpp"
+#include <stdexcept>
+
+struct full_parse
+{
+    full_parse(char const* first, char const* last) : first(first), last(last) {}
+
+    void operator()() const
+    {
+        token_iterator toks = tokens(first, last);
+        json_value const v = parse_json_value(toks);
+        keep(v);
+    }
+
+    char const* first;
+    char const* last;
+};
+
+struct validate_only
+{
+    validate_only(char const* first, char const* last) : first(first), last(last) {}
+
+    void operator()() const
+    {
+        if (!validate_json(first, last))
+            throw std::logic_error("benchmark input is invalid");
+    }
+
+    char const* first;
+    char const* last;
+};
+
+int main(int const argc, char const* argv[])
+{
+    std::size_t const size = parse_size(argc > 1 ? argv[1] : "16M");
+    file_source doc(argc > 2 ? argv[2] : "test.json");
+
+    std::string const text = scale(doc.begin(), doc.end(), size);
+    char const* const first = text.data();
+    char const* const last = first + text.size();
+
+    double const t_parse = time_it(full_parse(first, last));
+    double const t_validate = time_it(validate_only(first, last));
+
+    std::printf("%lu bytes\n", (unsigned long)text.size());
+    report("parse_json_value", t_parse, text.size());
+    report("validate_json", t_validate, text.size());
+    std::printf("speedup: %.1fx\n", t_parse / t_validate);
+}
@@ -21,13 +21,26 @@
 # include <boost/range/as_array.hpp>
 #endif
 
-#include <boost/phoenix.hpp>
-#include <boost/phoenix/object.hpp>
-
 #include <boost/operators.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/iterator/indirect_iterator.hpp>
+
+#include "arena.hpp"
+#include "shortest_float.hpp"
+#include "json_escape.hpp"
 
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
 
+#include <limits>
+#include <string>
 #include <vector>
 #include <ostream>
 
@@ -47,6 +60,11 @@ std::ostream& operator<<(std::ostream& s, json_null const& x)
     return s << "null";
 }
 
+// All nulls are equal; without these, comparing two nulls would
+// convert them to json_value and recurse forever
+inline bool operator==(json_null, json_null) { return true; }
+inline bool operator<(json_null, json_null) { return false; }
+
 #define USE_MOVE
 
 #ifdef USE_MOVE
@@ -67,15 +85,22 @@ typedef boost::int64_t json_integer;
 typedef boost::int32_t json_integer;
 #endif 
 
-struct json_string : boost::container::string
+// Strings, arrays and objects take an arena_allocator, so that a
+// parsed tree can live in one arena instead of in many heap blocks
+struct json_string
+  : boost::container::basic_string<char, std::char_traits<char>, arena_allocator<char> >
 {
-    typedef boost::container::string rep_t;
+    typedef boost::container::basic_string<
+        char, std::char_traits<char>, arena_allocator<char> > rep_t;
+    typedef rep_t::allocator_type allocator_type;
     
-    json_string(char const* p) : rep_t(p) {}
+    json_string(char const* p, allocator_type a = allocator_type()) : rep_t(p, a) {}
 
     json_string(rep_t rhs) { rhs.swap(*this); }
     
     json_string() {}
+
+    explicit json_string(allocator_type a) : rep_t(a) {}
     
     json_string(json_string const& rhs)
         : rep_t(rhs)
@@ -84,8 +109,8 @@ struct json_string : boost::container::string
     }
 
     template <class Iterator>
-    json_string(Iterator begin, Iterator end)
-        : rep_t(begin, end)
+    json_string(Iterator begin, Iterator end, allocator_type a = allocator_type())
+        : rep_t(begin, end, a)
     {
     }
 
@@ -116,39 +141,360 @@ struct json_string : boost::container::string
     COPYABLE_AND_MOVABLE(json_string)
 };
 
-static const char chars_needing_escape[] = "\\/\"\b\f\n\r\t";
-static const char escape_suffixes[] = "\\/\"bfnrt";
+// The immutable text of an object key, and its hash.  Atoms on the
+// heap are reference-counted; atoms in an arena live exactly as long as
+// it does.  A table id of 0 means the atom wasn't interned.
+struct json_atom : boost::noncopyable
+{
+    json_atom(char const* first, char const* last, unsigned long table, arena* memory = 0)
+      : text(first, last, json_string::allocator_type(memory)),
+        hash(boost::hash_range(first, last)),
+        table(table), counted(!memory), refs(0) {}
+
+    json_string const text;
+    std::size_t const hash;
+    unsigned long const table;
+    bool const counted;
+    mutable boost::detail::atomic_count refs;
+};
 
-BOOST_STATIC_ASSERT(sizeof(chars_needing_escape) == sizeof(escape_suffixes));
+class json_atom_table;
 
-inline std::ostream& operator<<(std::ostream& os, json_string const& s)
+// An object key.  Copies share one heap atom; an empty key, including
+// a moved-from one, has none.  Keys interned by the same
+// json_atom_table are equal exactly when they share an atom, so
+// comparing them for equality never looks at the text.
+class json_key
+  : boost::totally_ordered<json_key>
 {
-#ifdef USE_XPRESSIVE 
-    typedef boost::xpressive::basic_regex<json_string::const_iterator> pattern_t;
-    static pattern_t escape_me = pattern_t::compile("[/\"\\\\]");
-    return os << "\"" << boost::xpressive::regex_replace(s, escape_me, "\\$&").c_str() << "\"";
-#else
-    typedef json_string::rep_t string;
-    string const& rep = s;
-    using namespace boost::phoenix::placeholders;
-    using namespace boost::phoenix;
-    using namespace boost::phoenix::local_names;
-    
-    return os << "\""
-              << boost::find_format_all_copy(
-                  rep,
-                  boost::token_finder(boost::is_any_of(chars_needing_escape)),
-                  let ( _c = find(boost::as_array(chars_needing_escape), arg1[0]) )[
-                      string("\\") + val(escape_suffixes)[_c - &chars_needing_escape[0]]
-                  ]
-              )
-              << "\"";
+ public:
+    json_key() : rep(0) {}
+    json_key(char const* s) : rep(acquire(new json_atom(s, s + std::strlen(s), 0))) {}
+    json_key(json_string const& s)
+      : rep(acquire(new json_atom(s.data(), s.data() + s.size(), 0))) {}
+    json_key(char const* first, char const* last)
+      : rep(acquire(new json_atom(first, last, 0))) {}
+
+    // A copy of a key in an arena goes to the heap, like a copy of any
+    // other part of the tree
+    json_key(json_key const& k)
+      : rep(!k.rep || k.rep->counted
+            ? acquire(k.rep) : acquire(new json_atom(k.begin(), k.end(), 0)))
+    {}
+
+    json_key& operator=(COPY_ASSIGN_REF(json_key) k)
+    {
+        json_key copy(k);
+        std::swap(rep, copy.rep);
+        return *this;
+    }
+
+#ifdef USE_MOVE
+    json_key(BOOST_RV_REF(json_key) k) : rep(k.rep)
+    {
+        k.rep = 0;
+    }
+
+    json_key& operator=(BOOST_RV_REF(json_key) k)
+    {
+        std::swap(rep, k.rep);
+        return *this;
+    }
 #endif
-}
-    
+
+    ~json_key() { release(rep); }
+
+    json_string const& str() const { return rep ? rep->text : empty(); }
+    bool interned() const { return rep && rep->table != 0; }
+
+    // boost::hash_range over the text, computed once per atom
+    std::size_t hash() const { return rep ? rep->hash : 0; }
+
+    friend bool operator==(json_key const& x, json_key const& y)
+    {
+        if (x.rep == y.rep)
+            return true;
+        if (x.rep && y.rep && x.rep->table != 0 && x.rep->table == y.rep->table)
+            return false;
+        return x.str() == y.str();
+    }
+
+    // Interning doesn't help here: order is by text
+    friend bool operator<(json_key const& x, json_key const& y)
+    {
+        return x.rep != y.rep && x.str() < y.str();
+    }
+
+ private:
+    COPYABLE_AND_MOVABLE(json_key)
+    friend class json_atom_table;
+
+    // Shares an atom handed out by a table
+    explicit json_key(json_atom const* a) : rep(acquire(a)) {}
+
+    char const* begin() const { return str().data(); }
+    char const* end() const { return str().data() + str().size(); }
+
+    static json_atom const* acquire(json_atom const* a)
+    {
+        if (a && a->counted)
+            ++a->refs;
+        return a;
+    }
+
+    static void release(json_atom const* a)
+    {
+        if (a && a->counted && --a->refs == 0)
+            delete a;
+    }
+
+    static json_string const& empty()
+    {
+        static json_string const e;
+        return e;
+    }
+
+    json_atom const* rep;
+};
+
+// Hands out one atom per distinct key text.  On the heap, the table
+// holds a reference to each atom, and keys hold their own, so keys may
+// outlive the table.  Given an arena, the table puts the atoms there
+// too, and the parser builds the whole document in it.  Not
+// thread-safe: give each thread its own table.
+class json_atom_table : boost::noncopyable
+{
+ public:
+    explicit json_atom_table(arena* memory = 0)
+      : id(++next_id()), memory(memory),
+        atoms(0, hash(), same_text(), atom_set::allocator_type(memory))
+    {}
+
+    ~json_atom_table()
+    {
+        BOOST_FOREACH(json_atom const* a, atoms)
+            json_key::release(a);
+    }
+
+    json_key intern(char const* first, char const* last)
+    {
+        text_range const text(first, last);
+        atom_set::const_iterator const found = atoms.find(text, hash(), same_text());
+        if (found != atoms.end())
+            return json_key(*found);
+
+        json_atom const* const a = memory
+            ? new (memory->allocate(sizeof(json_atom), boost::alignment_of<json_atom>::value))
+                  json_atom(first, last, id, memory)
+            : new json_atom(first, last, id);
+        json_key k(a);
+        atoms.insert(a);
+        json_key::acquire(a);
+        return k;
+    }
+
+    json_key intern(json_string const& s)
+    {
+        return intern(s.data(), s.data() + s.size());
+    }
+
+    // Number of distinct keys
+    std::size_t size() const { return atoms.size(); }
+
+    // Allocates the containers of a document parsed with this table
+    arena_allocator<char> allocator() const { return arena_allocator<char>(memory); }
+
+ private:
+    typedef std::pair<char const*, char const*> text_range;
+
+    static text_range range(json_atom const* a)
+    {
+        return text_range(a->text.data(), a->text.data() + a->text.size());
+    }
+
+    struct hash
+    {
+        std::size_t operator()(text_range const& t) const
+        {
+            return boost::hash_range(t.first, t.second);
+        }
+
+        std::size_t operator()(json_atom const* a) const
+        {
+            return a->hash;
+        }
+    };
+
+    struct same_text
+    {
+        bool operator()(text_range const& x, text_range const& y) const
+        {
+            return x.second - x.first == y.second - y.first
+                && std::memcmp(x.first, y.first, x.second - x.first) == 0;
+        }
+
+        bool operator()(text_range const& x, json_atom const* y) const
+        {
+            return (*this)(x, range(y));
+        }
+
+        bool operator()(json_atom const* x, text_range const& y) const
+        {
+            return (*this)(range(x), y);
+        }
+
+        bool operator()(json_atom const* x, json_atom const* y) const
+        {
+            return (*this)(range(x), range(y));
+        }
+    };
+
+    typedef boost::unordered_set<
+        json_atom const*, hash, same_text, arena_allocator<json_atom const*>
+    > atom_set;
+
+    static boost::detail::atomic_count& next_id()
+    {
+        static boost::detail::atomic_count n(0);
+        return n;
+    }
+
+    unsigned long const id;
+    arena* const memory;
+    atom_set atoms;
+};
+
 struct json_value;
-typedef boost::container::vector<json_value> json_array;
-typedef boost::container::flat_map<json_string, json_value> json_object;
+typedef boost::container::vector<json_value, arena_allocator<json_value> > json_array;
+
+// An object's members, in an arena_vector.  A small object keeps them
+// sorted by key, like a flat_map, and finds them by bisection.  One of
+// hash_threshold members or more, or one told to hash_keys(), finds
+// them through an open-addressed index of their keys' hashes, so that
+// lookup and insertion take O(1) however wide it grows, and leaves
+// them where they are, adding new ones at the end.  The parser decides
+// before building an object, so a wide one prints in input order, but
+// one that grows wide through operator[] keeps its first members in
+// key order, and only those added since in the order they came.  The
+// index comes from the members' allocator, and the whole object still
+// fits in 32 bytes.
+class json_object
+  : boost::totally_ordered<json_object>
+{
+ public:
+    typedef json_key key_type;
+    typedef json_value mapped_type;
+    typedef std::pair<json_key, json_value> value_type;
+    typedef arena_vector<value_type> sequence_type;
+    typedef sequence_type::allocator_type allocator_type;
+    typedef sequence_type::iterator iterator;
+    typedef sequence_type::const_iterator const_iterator;
+    typedef std::size_t size_type;
+
+    // Where the parser, and operator[], switch to a hash index
+    static std::size_t const default_hash_threshold = 16;
+
+    json_object() : index(0) {}
+    explicit json_object(allocator_type const& a) : members(a), index(0) {}
+    json_object(json_object const& x);
+
+#ifdef USE_MOVE
+    json_object(BOOST_RV_REF(json_object) x)
+      : members(MOVE(x.members)), index(x.index)
+    {
+        x.index = 0;
+    }
+#endif
+
+    ~json_object() { drop_index(); }
+
+    json_object& operator=(COPY_ASSIGN_REF(json_object) x)
+    {
+        json_object(x).swap(*this);
+        return *this;
+    }
+
+#ifdef USE_MOVE
+    json_object& operator=(BOOST_RV_REF(json_object) x)
+    {
+        json_object(MOVE(x)).swap(*this);
+        return *this;
+    }
+#endif
+
+    void swap(json_object& x)
+    {
+        members.swap(x.members);
+        std::swap(index, x.index);
+    }
+
+    std::size_t size() const { return members.size(); }
+    bool empty() const { return members.empty(); }
+    std::size_t capacity() const { return members.capacity(); }
+    allocator_type get_allocator() const { return members.get_allocator(); }
+
+    iterator begin() { return members.begin(); }
+    iterator end() { return members.end(); }
+    const_iterator begin() const { return members.begin(); }
+    const_iterator end() const { return members.end(); }
+
+    void reserve(std::size_t n);
+
+    // Adopts members sorted by key, no two the same
+    void adopt_sequence(boost::container::ordered_unique_range_t, BOOST_RV_REF(sequence_type) s);
+
+    // Adopts members in any order, and hashes their keys.  Of several
+    // with the same key, the first keeps its place and the last its
+    // value, as with o[key] = value.
+    void adopt_sequence(BOOST_RV_REF(sequence_type) s);
+
+    // Whether members are found through the hash index, in the order
+    // they were added, or by bisection, in key order
+    bool hashed() const { return index != 0; }
+    void hash_keys();
+    void sort_keys();
+
+    iterator find(json_key const& k);
+    const_iterator find(json_key const& k) const;
+
+    json_value& operator[](json_key const& k);
+#ifdef USE_MOVE
+    json_value& operator[](BOOST_RV_REF(json_key) k);
+#endif
+
+    // Allocated for the index
+    std::size_t index_bytes() const { return index ? (slots() + 1) * sizeof(slot) : 0; }
+
+    friend bool operator==(json_object const& x, json_object const& y);
+    friend bool operator<(json_object const& x, json_object const& y);
+
+ private:
+    COPYABLE_AND_MOVABLE(json_object)
+
+    // A member's position plus one, or 0 if the slot is empty, and the
+    // low bits of its key's hash.  index[0].hash holds the number of
+    // slots that follow, less one.
+    struct slot
+    {
+        boost::uint32_t hash;
+        boost::uint32_t position;
+    };
+    typedef arena_allocator<slot> slot_allocator;
+
+    std::size_t slots() const { return index ? std::size_t(index[0].hash) + 1 : 0; }
+
+    // Where key k is, or the empty slot where it would go
+    slot* lookup(json_key const& k, boost::uint32_t hash) const;
+
+    // Makes room in the index for n members, keeping what it holds
+    void grow_index(std::size_t n);
+    void drop_index();
+
+    json_value& insert(BOOST_RV_REF(json_key) k);
+
+    sequence_type members;
+    slot* index;
+};
 
 struct json_value
   : boost::totally_ordered<json_value>
@@ -165,19 +511,20 @@ struct json_value
       , boost::container::flat_map<json_string, boost::recursive_variant_>
     >::type stored_type;
 #else 
+    // The containers support incomplete element types, so they can be
+    // held directly, without recursive_wrapper's extra heap node
     typedef boost::variant <
         json_null,
         json_string,
         bool,
         json_integer,
         json_float,
-        boost::recursive_wrapper<json_array>,
-        boost::recursive_wrapper<json_object>
+        json_array,
+        json_object
     > stored_type;
 #endif
     friend bool operator==(json_value const& x, json_value const& y);
-    friend bool operator<(json_value const& x, json_value const& y);
-    friend std::ostream& operator<<(std::ostream& s, json_value const& x);
+    friend int compare(json_value const& x, json_value const& y);
     
  public:
     json_value() {}
@@ -195,6 +542,14 @@ struct json_value
         LOG("json_value copy");
     }
 
+#ifdef USE_MOVE
+    // Adopt a container or string without copying it, keeping its
+    // allocator
+    json_value(BOOST_RV_REF(json_string) x) : stored_value(MOVE(x)) {}
+    json_value(BOOST_RV_REF(json_array) x) : stored_value(MOVE(x)) {}
+    json_value(BOOST_RV_REF(json_object) x) : stored_value(MOVE(x)) {}
+#endif
+
 #ifdef USE_MOVE
     template <class T>
     json_value& operator=(T const& rhs)
@@ -236,6 +591,13 @@ struct json_value
     {
         lhs.stored_value.swap(rhs.stored_value);
     }
+
+    // Makes json_value visitable with boost::apply_visitor
+    template <class Visitor>
+    typename Visitor::result_type apply_visitor(Visitor& v) const
+    {
+        return stored_value.apply_visitor(v);
+    }
  private:
     COPYABLE_AND_MOVABLE(json_value)
     template <class T>
@@ -253,54 +615,425 @@ struct json_value
     stored_type stored_value;
 };
 
-inline std::ostream& operator<<(std::ostream& s, json_array const& a)
+// Orders members by key, and finds keys among them
+struct member_key_less
+{
+    typedef bool result_type;
+    typedef json_object::value_type first_argument_type;
+    typedef json_object::value_type second_argument_type;
+
+    bool operator()(json_object::value_type const& x, json_object::value_type const& y) const
+    {
+        return x.first < y.first;
+    }
+
+    bool operator()(json_object::value_type const& x, json_key const& k) const
+    {
+        return x.first < k;
+    }
+
+    bool operator()(json_key const& k, json_object::value_type const& x) const
+    {
+        return k < x.first;
+    }
+};
+
+inline json_object::json_object(json_object const& x)
+  : members(x.members), index(0)
+{
+    if (x.index)
+    {
+        index = slot_allocator(members.get_allocator()).allocate(x.slots() + 1);
+        std::memcpy(index, x.index, x.index_bytes());
+    }
+}
+
+inline void json_object::reserve(std::size_t n)
+{
+    members.reserve(n);
+    if (hashed())
+        grow_index(n);
+}
+
+inline void json_object::adopt_sequence(
+    boost::container::ordered_unique_range_t, BOOST_RV_REF(sequence_type) s)
+{
+    drop_index();
+    members = MOVE(s);
+}
+
+inline void json_object::adopt_sequence(BOOST_RV_REF(sequence_type) s)
+{
+    drop_index();
+    members = MOVE(s);
+    grow_index(members.size());
+
+    // Index each key's first member, and move the rest down over
+    // those whose keys came before
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+        boost::uint32_t const h = boost::uint32_t(members[i].first.hash());
+        slot* const found = lookup(members[i].first, h);
+        if (found->position)
+        {
+            members[found->position - 1].second = MOVE(members[i].second);
+            continue;
+        }
+        if (out != i)
+            members[out] = MOVE(members[i]);
+        found->hash = h;
+        found->position = boost::uint32_t(++out);
+    }
+    members.erase(members.begin() + out, members.end());
+}
+
+inline void json_object::hash_keys()
+{
+    if (hashed())
+        return;
+    grow_index(members.size());
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+        boost::uint32_t const h = boost::uint32_t(members[i].first.hash());
+        slot* const s = lookup(members[i].first, h);
+        s->hash = h;
+        s->position = boost::uint32_t(i + 1);
+    }
+}
+
+inline void json_object::sort_keys()
+{
+    if (!hashed())
+        return;
+    drop_index();
+    std::sort(members.begin(), members.end(), member_key_less());
+}
+
+inline json_object::slot* json_object::lookup(json_key const& k, boost::uint32_t hash) const
 {
-    char const* separator = " ";
-    s << "[" << std::flush;
-    BOOST_FOREACH(json_value const& v, a)
+    std::size_t const mask = index[0].hash;
+    for (std::size_t i = hash & mask; ; i = (i + 1) & mask)
     {
-        s << separator << v << std::flush;
-        separator = ", ";
+        slot* const s = index + 1 + i;
+        if (!s->position || (s->hash == hash && members[s->position - 1].first == k))
+            return s;
     }
-    s << " ]";
-    return s;
 }
 
-inline std::ostream& operator<<(std::ostream& s, json_object const& o)
+inline void json_object::grow_index(std::size_t n)
 {
-    char const* separator = " ";
-    s << "{";
-    BOOST_FOREACH(json_object::value_type const& v, o)
+    // At most half full
+    std::size_t size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    if (size <= slots())
+        return;
+
+    slot* const old = index;
+    std::size_t const old_slots = slots();
+    index = slot_allocator(members.get_allocator()).allocate(size + 1);
+    std::memset(index, 0, (size + 1) * sizeof(slot));
+    index[0].hash = boost::uint32_t(size - 1);
+
+    // The hashes are cached, so the keys needn't be looked at
+    for (std::size_t i = 1; i <= old_slots; ++i)
+    {
+        if (!old[i].position)
+            continue;
+        std::size_t j = old[i].hash & (size - 1);
+        while (index[1 + j].position)
+            j = (j + 1) & (size - 1);
+        index[1 + j] = old[i];
+    }
+    if (old)
+        slot_allocator(members.get_allocator()).deallocate(old, old_slots + 1);
+}
+
+inline void json_object::drop_index()
+{
+    if (index)
+        slot_allocator(members.get_allocator()).deallocate(index, slots() + 1);
+    index = 0;
+}
+
+inline json_object::iterator json_object::find(json_key const& k)
+{
+    if (hashed())
+    {
+        slot const* const s = lookup(k, boost::uint32_t(k.hash()));
+        return s->position ? begin() + (s->position - 1) : end();
+    }
+    iterator const i = std::lower_bound(begin(), end(), k, member_key_less());
+    return i != end() && i->first == k ? i : end();
+}
+
+inline json_object::const_iterator json_object::find(json_key const& k) const
+{
+    return const_cast<json_object*>(this)->find(k);
+}
+
+inline json_value& json_object::operator[](json_key const& k)
+{
+    iterator const i = find(k);
+    return i != end() ? i->second : insert(json_key(k));
+}
+
+#ifdef USE_MOVE
+inline json_value& json_object::operator[](BOOST_RV_REF(json_key) k)
+{
+    iterator const i = find(k);
+    return i != end() ? i->second : insert(MOVE(k));
+}
+#endif
+
+// Adds a member for k, which isn't there yet
+inline json_value& json_object::insert(BOOST_RV_REF(json_key) k)
+{
+    if (!hashed() && members.size() + 1 >= default_hash_threshold)
+        hash_keys();
+
+    if (hashed())
     {
-        s << separator << v.first << " : " << v.second;
-        separator = ", ";
+        grow_index(members.size() + 1);
+        boost::uint32_t const h = boost::uint32_t(k.hash());
+        slot* const s = lookup(k, h);
+        members.emplace_back(MOVE(k), json_value());
+        s->hash = h;
+        s->position = boost::uint32_t(members.size());
+        return members.back().second;
     }
-    s << " }";
-    return s;
+
+    std::size_t const position
+        = std::lower_bound(begin(), end(), k, member_key_less()) - begin();
+    members.emplace_back(MOVE(k), json_value());
+    std::rotate(begin() + position, end() - 1, end());
+    return members[position].second;
 }
 
-template <class T, class F> struct with_result_type : F
+// ------------ output --------------
+
+// Serializes JSON into a growable buffer.  Given a file descriptor, it
+// hands the buffer to write(2) each time a block fills, instead of
+// flushing a stream per element.
+class json_writer
+  : public boost::static_visitor<>, boost::noncopyable
 {
-    typedef T result_type;
-    with_result_type(F x) : F(x) {}
+ public:
+    enum format { compact, pretty };
+
+    explicit json_writer(format f = compact, int fd = -1, std::size_t block = 1 << 16)
+      : f(f), fd(fd), block(block), depth(0)
+    {
+        if (fd >= 0)
+            buffer.reserve(block + block / 4);
+    }
+
+    // Errors are lost here; call flush() to see them
+    ~json_writer()
+    {
+        try { flush(); } catch (...) {}
+    }
+
+    void write(json_value const& v)
+    {
+        boost::apply_visitor(*this, v);
+        spill();
+    }
+
+    // Raw bytes, e.g. a newline between records
+    void append(char const* first, std::size_t n)
+    {
+        buffer.append(first, n);
+        spill();
+    }
+
+    // Hand everything buffered to the file descriptor, if any.  Throws
+    // std::runtime_error if write(2) fails.
+    void flush()
+    {
+        if (fd < 0)
+            return;
+        char const* p = buffer.data();
+        char const* const last = p + buffer.size();
+        while (p != last)
+        {
+            ssize_t const n = ::write(fd, p, last - p);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::runtime_error(std::string("json_writer: ") + std::strerror(errno));
+            p += n;
+        }
+        buffer.clear();
+    }
+
+    // What has been written and not flushed
+    char const* data() const { return buffer.data(); }
+    std::size_t size() const { return buffer.size(); }
+
+    void operator()(json_null)
+    {
+        buffer.append("null", 4);
+    }
+
+    void operator()(bool b)
+    {
+        if (b)
+            buffer.append("true", 4);
+        else
+            buffer.append("false", 5);
+    }
+
+    void operator()(json_integer i)
+    {
+        char digits[24];
+        char* p = digits + sizeof(digits);
+        boost::uint64_t n = i < 0 ? 0 - boost::uint64_t(i) : boost::uint64_t(i);
+        do
+        {
+            *--p = char('0' + n % 10);
+            n /= 10;
+        }
+        while (n);
+        if (i < 0)
+            *--p = '-';
+        buffer.append(p, digits + sizeof(digits) - p);
+    }
+
+    void operator()(json_float x)
+    {
+        // JSON has no infinities or NaNs
+        if (!(x - x == 0))
+        {
+            buffer.append("null", 4);
+            return;
+        }
+        char text[shortest_float::max_length];
+        buffer.append(text, shortest_float::format(x, text) - text);
+    }
+
+    void operator()(json_string const& s)
+    {
+        string(s.data(), s.data() + s.size());
+    }
+
+    void operator()(json_key const& k)
+    {
+        (*this)(k.str());
+    }
+
+    void operator()(json_array const& a)
+    {
+        if (a.empty())
+        {
+            buffer.append("[]", 2);
+            return;
+        }
+        buffer += '[';
+        ++depth;
+        for (json_array::const_iterator i = a.begin(); i != a.end(); ++i)
+        {
+            if (i != a.begin())
+                buffer += ',';
+            newline();
+            boost::apply_visitor(*this, *i);
+            spill();
+        }
+        --depth;
+        newline();
+        buffer += ']';
+    }
+
+    void operator()(json_object const& o)
+    {
+        if (o.empty())
+        {
+            buffer.append("{}", 2);
+            return;
+        }
+        buffer += '{';
+        ++depth;
+        for (json_object::const_iterator i = o.begin(); i != o.end(); ++i)
+        {
+            if (i != o.begin())
+                buffer += ',';
+            newline();
+            (*this)(i->first);
+            if (f == pretty)
+                buffer.append(": ", 2);
+            else
+                buffer += ':';
+            boost::apply_visitor(*this, i->second);
+            spill();
+        }
+        --depth;
+        newline();
+        buffer += '}';
+    }
+
+ private:
+    void string(char const* first, char const* last)
+    {
+        json_escape::append_quoted(buffer, first, last);
+    }
+
+    void newline()
+    {
+        if (f == pretty)
+        {
+            buffer += '\n';
+            buffer.append(2 * depth, ' ');
+        }
+    }
+
+    // Write out a full block
+    void spill()
+    {
+        if (fd >= 0 && buffer.size() >= block)
+            flush();
+    }
+
+    format const f;
+    int const fd;
+    std::size_t const block;
+    std::size_t depth;
+    std::string buffer;
 };
 
-template <class T, class F>
-with_result_type<T,F> make_result_type(F x)
+template <class T>
+inline std::ostream& print_json(std::ostream& os, T const& x)
 {
-    return with_result_type<T, F>(x);
+    json_writer w;
+    w(x);
+    return os.write(w.data(), w.size());
 }
 
-inline std::ostream& operator<<(std::ostream& s, json_value const& x)
+inline std::ostream& operator<<(std::ostream& os, json_string const& s)
 {
-    boost::io::ios_flags_saver ifs( s );
-    s << std::boolalpha;
-    
-    using namespace boost::phoenix::placeholders;
-    using namespace boost::phoenix;
-    
-    boost::apply_visitor( make_result_type<std::ostream&>(s << arg1), x.stored_value );
-    return s;
+    return print_json(os, s);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_key const& k)
+{
+    return print_json(os, k);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_array const& a)
+{
+    return print_json(os, a);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_object const& o)
+{
+    return print_json(os, o);
+}
+
+inline std::ostream& operator<<(std::ostream& os, json_value const& x)
+{
+    json_writer w;
+    w.write(x);
+    return os.write(w.data(), w.size());
 }
 
 template <class Derived>
@@ -330,15 +1063,55 @@ struct equal : strict_binary_predicate<equal>
     }
 };
 
-struct less : strict_binary_predicate<less>
+// Negative, zero or positive as x sorts before, with or after y.
+// Values of different types are unordered, as they always were, so
+// they compare as 0 without being equal.  Containers compare each pair
+// of elements once, where lexicographical_compare would try < both
+// ways, taking time exponential in nesting depth.
+int compare(json_value const& x, json_value const& y);
+int compare(json_object const& x, json_object const& y);
+
+struct three_way : boost::static_visitor<int>
 {
+    template <class T, class U>
+    int operator()(T const& x, U const& y) const
+    {
+        return 0;
+    }
+
     template <class T>
-    bool check( T const& x, T const& y ) const
+    int operator()(T const& x, T const& y) const
+    {
+        return x < y ? -1 : y < x;
+    }
+
+    int operator()(json_string const& x, json_string const& y) const
+    {
+        int const c = x.compare(y);
+        return c < 0 ? -1 : c > 0;
+    }
+
+    int operator()(json_array const& x, json_array const& y) const
+    {
+        for (std::size_t i = 0; i < x.size() && i < y.size(); ++i)
+        {
+            if (int const c = compare(x[i], y[i]))
+                return c;
+        }
+        return x.size() < y.size() ? -1 : x.size() > y.size();
+    }
+
+    int operator()(json_object const& x, json_object const& y) const
     {
-        return x < y;
+        return compare(x, y);
     }
 };
 
+inline int compare(json_value const& x, json_value const& y)
+{
+    return boost::apply_visitor(three_way(), x.stored_value, y.stored_value);
+}
+
 inline bool operator==(json_value const& x, json_value const& y)
 {
     return boost::apply_visitor(equal(), x.stored_value, y.stored_value);
@@ -346,14 +1119,123 @@ inline bool operator==(json_value const& x, json_value const& y)
 
 inline bool operator<(json_value const& x, json_value const& y)
 {
-    return boost::apply_visitor(less(), x.stored_value, y.stored_value);
+    return compare(x, y) < 0;
+}
+
+// Hashed objects are in no particular order, so their members are
+// looked up, or sorted, to compare them
+inline bool operator==(json_object const& x, json_object const& y)
+{
+    if (x.size() != y.size())
+        return false;
+    if (!x.hashed() && !y.hashed())
+        return std::equal(x.begin(), x.end(), y.begin());
+    for (json_object::const_iterator i = x.begin(); i != x.end(); ++i)
+    {
+        json_object::const_iterator const j = y.find(i->first);
+        if (j == y.end() || !(j->second == i->second))
+            return false;
+    }
+    return true;
+}
+
+// Keys in one object are distinct, so their members sort by key alone
+struct member_pointer_less
+{
+    bool operator()(json_object::value_type const* x, json_object::value_type const* y) const
+    {
+        return x->first < y->first;
+    }
+};
+
+template <class I, class J>
+int compare_members(I i, I const i_end, J j, J const j_end)
+{
+    for (; i != i_end && j != j_end; ++i, ++j)
+    {
+        if (!(i->first == j->first))
+            return i->first < j->first ? -1 : 1;
+        if (int const c = compare(i->second, j->second))
+            return c;
+    }
+    return i != i_end ? 1 : -int(j != j_end);
+}
+
+inline int compare(json_object const& x, json_object const& y)
+{
+    if (!x.hashed() && !y.hashed())
+        return compare_members(x.begin(), x.end(), y.begin(), y.end());
+
+    std::vector<json_object::value_type const*> xs, ys;
+    for (json_object::const_iterator i = x.begin(); i != x.end(); ++i)
+        xs.push_back(&*i);
+    for (json_object::const_iterator i = y.begin(); i != y.end(); ++i)
+        ys.push_back(&*i);
+    std::sort(xs.begin(), xs.end(), member_pointer_less());
+    std::sort(ys.begin(), ys.end(), member_pointer_less());
+    return compare_members(boost::make_indirect_iterator(xs.begin()),
+                           boost::make_indirect_iterator(xs.end()),
+                           boost::make_indirect_iterator(ys.begin()),
+                           boost::make_indirect_iterator(ys.end()));
+}
+
+inline bool operator<(json_object const& x, json_object const& y)
+{
+    return compare(x, y) < 0;
 }
 
+// A hash consistent with ==, for boost::hash and the unordered
+// containers.  It visits the whole tree on every call: a tree's
+// elements can be written through references it has handed out, so
+// there is nowhere to keep it that a write would be sure to reach.
+// Objects combine their members in no particular order, since hashed
+// and sorted objects with the same members are equal.
+struct structural_hash : boost::static_visitor<std::size_t>
+{
+    std::size_t operator()(json_null) const { return 0x6e756c6c; }
+    std::size_t operator()(bool x) const { return x ? 0x74727565 : 0x66616c73; }
+    std::size_t operator()(json_integer x) const { return seeded(1, boost::hash_value(x)); }
+    std::size_t operator()(json_float x) const { return seeded(2, boost::hash_value(x)); }
+
+    std::size_t operator()(json_string const& s) const
+    {
+        return seeded(3, boost::hash_range(s.data(), s.data() + s.size()));
+    }
+
+    std::size_t operator()(json_array const& a) const
+    {
+        std::size_t h = 4;
+        BOOST_FOREACH(json_value const& v, a)
+            boost::hash_combine(h, boost::apply_visitor(*this, v));
+        return h;
+    }
+
+    std::size_t operator()(json_object const& o) const
+    {
+        std::size_t sum = 0;
+        BOOST_FOREACH(json_object::value_type const& m, o)
+            sum += seeded(m.first.hash(), boost::apply_visitor(*this, m.second));
+        return seeded(5, sum);
+    }
+
+    static std::size_t seeded(std::size_t seed, std::size_t h)
+    {
+        boost::hash_combine(seed, h);
+        return seed;
+    }
+};
+
+inline std::size_t hash_value(json_value const& v)
+{
+    return boost::apply_visitor(structural_hash(), v);
+}
 
 // ------------ test driver --------------
 
 #ifndef NO_TEST
 #include <iostream>
+#include <sstream>
+#include <cstdlib>
 
 int main(int const argc, char const*argv[])
 {
@@ -390,5 +1272,143 @@ int main(int const argc, char const*argv[])
     a.push_back(5);
     std::sort(a.begin(), a.end());
     std::cout << a << std::endl;
+
+    // Interned keys with the same text share one atom
+    json_atom_table atoms;
+    json_key const k1 = atoms.intern("lick");
+    json_key const k2 = atoms.intern(json_string("lick"));
+    assert(k1.interned() && &k1.str() == &k2.str() && atoms.size() == 1);
+    assert(k1 == k2 && k1 != atoms.intern("pork") && atoms.size() == 2);
+    assert(k1 == json_key("lick") && json_key("lick") == k1 && !json_key("lick").interned());
+    assert(json_key() == json_key("") && json_key("bar") < k1 && k1 < atoms.intern("pork"));
+
+    json_object p;
+    p[atoms.intern("foo")] = 1;
+    p[atoms.intern("bar")] = "baz";
+    p[atoms.intern("xxx")] = 3.14;
+    p[k2] = a;
+    p[atoms.intern("pork")] = true;
+    p["lick"] = o["lick"];
+    assert(p == o);
+
+    // Keys outlive their table
+    json_key survivor;
+    {
+        json_atom_table scratch;
+        survivor = scratch.intern("survivor");
+    }
+    assert(survivor == "survivor" && survivor.interned());
+
+    // Wide objects switch to a hash index.  Members added after that
+    // keep the order they were added in, after those already sorted.
+    json_object wide, sorted;
+    char key[16];
+    for (int i = 0; i < 40; ++i)
+    {
+        std::snprintf(key, sizeof(key), "k%02d", 39 - i);
+        wide[key] = i;
+        assert(wide.hashed() == (i + 1 >= int(json_object::default_hash_threshold)));
+    }
+    assert(wide.index_bytes() > 0 && wide.size() == 40);
+    assert(wide.begin()->first == "k25" && (wide.end() - 1)->first == "k00");
+    assert(wide["k07"] == 32 && wide.find("k40") == wide.end() && wide.size() == 40);
+    wide["k39"] = "again";
+    assert(wide.size() == 40 && wide["k39"] == "again");
+    wide["k39"] = 0;
+
+    for (int i = 39; i >= 0; --i)
+    {
+        std::snprintf(key, sizeof(key), "k%02d", 39 - i);
+        sorted[atoms.intern(key)] = i;
+    }
+    sorted.sort_keys();
+    assert(!sorted.hashed() && sorted.begin()->first == "k00");
+    assert(wide == sorted && !(wide < sorted) && !(sorted < wide));
+    sorted["k05"] = 5;
+    assert(wide != sorted && (wide < sorted) != (sorted < wide));
+    json_object const copied(wide);
+    assert(copied.hashed() && copied == wide && copied.find(atoms.intern("k12"))->second == 27);
+    wide.sort_keys();
+    assert(!wide.hashed() && wide.index_bytes() == 0 && wide.begin()->first == "k00" && wide == copied);
+
+    // Of repeated keys, the first keeps its place and the last its value
+    json_object::sequence_type repeated;
+    repeated.push_back(json_object::value_type("b", 1));
+    repeated.push_back(json_object::value_type("a", 2));
+    repeated.push_back(json_object::value_type("b", 3));
+    json_object r;
+    r.adopt_sequence(MOVE(repeated));
+    assert(r.hashed() && r.size() == 2 && r.begin()->first == "b" && r["b"] == 3);
+    std::ostringstream hashed_text;
+    hashed_text << r;
+    assert(hashed_text.str() == "{\"b\":3,\"a\":2}");
+
+    // Equal values hash alike, whatever order their members are in
+    assert(hash_value(json_value(wide)) == hash_value(json_value(copied)));
+    assert(hash_value(json_value(sorted)) != hash_value(json_value(copied)));
+    assert(hash_value(json_value(0.0)) == hash_value(json_value(-0.0)));
+    boost::unordered_set<json_value> distinct;
+    distinct.insert(json_value(wide));
+    distinct.insert(json_value(copied));
+    distinct.insert(json_value(sorted));
+    distinct.insert(json_value(a));
+    assert(distinct.size() == 3 && distinct.count(json_value(a)) == 1);
+
+    // Comparing deep nests takes time linear in their depth
+    json_value deep = 1, deeper = 2;
+    for (int d = 0; d < 100; ++d)
+    {
+        json_array wrap;
+        wrap.push_back(deep);
+        json_object member;
+        member["child"] = MOVE(wrap);
+        deep = member;
+        json_array other;
+        other.push_back(deeper);
+        member["child"] = MOVE(other);
+        deeper = member;
+    }
+    assert(deep < deeper && !(deeper < deep) && compare(deep, deeper) == -1);
+    assert(compare(deep, deep) == 0 && deep != deeper && deep == json_value(deep));
+    assert(compare(json_value(1), json_value("1")) == 0 && json_value(1) != json_value("1"));
+
+    // Escapes on both sides of the 16-byte scan
+    json_writer w;
+    w.write(json_string("tab\there \"q\" and more \\ \x01/\xc3\xa9\x1f"));
+    assert(std::string(w.data(), w.size())
+           == "\"tab\\there \\\"q\\\" and more \\\\ \\u0001/\xc3\xa9\\u001f\"");
+
+    json_array n;
+    n.push_back(-9223372036854775807LL - 1);
+    n.push_back(json_null());
+    n.push_back(2.0);
+    json_object po;
+    po["a"] = n;
+    po["b"] = json_object();
+    json_writer pw(json_writer::pretty);
+    pw.write(po);
+    assert(std::string(pw.data(), pw.size())
+           == "{\n  \"a\": [\n    -9223372036854775808,\n    null,\n    2.0\n  ],\n  \"b\": {}\n}");
+
+    // Small blocks through a file descriptor
+    char path[] = "/tmp/variant_testXXXXXX";
+    int const fd = ::mkstemp(path);
+    assert(fd >= 0);
+    {
+        json_writer fw(json_writer::compact, fd, 16);
+        fw.write(o);
+        fw.append("\n", 1);
+        fw.write(po);
+        assert(fw.size() < 16 + 64);
+    }
+    std::ostringstream printed;
+    printed << o << "\n" << po;
+    std::string const expected = printed.str();
+    std::string written(expected.size() + 1, '\0');
+    assert(::pread(fd, &written[0], written.size(), 0) == ssize_t(expected.size()));
+    written.resize(expected.size());
+    assert(written == expected);
+    ::close(fd);
+    ::unlink(path);
 }
 #endif
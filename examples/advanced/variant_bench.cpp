@@ -0,0 +1,19 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// repr_bench.hpp over variant.cpp's json_value, a boost::variant, which
+// parse.cpp can also parse
+//
+//   ./variant_bench [values]
+
+#define NO_TEST
+#include "parse.cpp"
+#define REPR_ORDERED
+#define REPR_PARSES
+#include "repr_bench.hpp"
+
+int main(int const argc, char const* argv[])
+{
+    return run_repr_bench("boost::variant", argc, argv);
+}
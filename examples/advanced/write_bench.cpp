@@ -0,0 +1,131 @@
+// Copyright Dave Abrahams 2012. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Serializes an array of copies of a file to /dev/null, with the
+// ostream printer variant.cpp used to have and with json_writer.
+//
+//   ./write_bench [file [size]]
+
+#define NO_TEST
+#include "parse.cpp"
+#include "bench.hpp"
+#include <boost/phoenix.hpp>
+#include <boost/phoenix/object.hpp>
+#include <fcntl.h>
+#include <fstream>
+
+// The old printer: a new string per escaped string, a flush per
+// array element
+namespace ostream_printer
+{
+  static const char chars_needing_escape[] = "\\/\"\b\f\n\r\t";
+  static const char escape_suffixes[] = "\\/\"bfnrt";
+
+  BOOST_STATIC_ASSERT(sizeof(chars_needing_escape) == sizeof(escape_suffixes));
+
+  struct print : boost::static_visitor<>
+  {
+      explicit print(std::ostream& os) : os(os) {}
+
+      void operator()(json_null) const { os << "null"; }
+      void operator()(bool b) const { os << (b ? "true" : "false"); }
+      void operator()(json_integer i) const { os << i; }
+      void operator()(json_float x) const { os << x; }
+
+      void operator()(json_string const& s) const
+      {
+          typedef json_string::rep_t string;
+          string const& rep = s;
+          using namespace boost::phoenix::placeholders;
+          using namespace boost::phoenix;
+          using namespace boost::phoenix::local_names;
+
+          os << "\""
+             << boost::find_format_all_copy(
+                 rep,
+                 boost::token_finder(boost::is_any_of(chars_needing_escape)),
+                 let ( _c = find(boost::as_array(chars_needing_escape), arg1[0]) )[
+                     string("\\") + val(escape_suffixes)[_c - &chars_needing_escape[0]]
+                 ]
+             )
+             << "\"";
+      }
+
+      void operator()(json_array const& a) const
+      {
+          char const* separator = " ";
+          os << "[" << std::flush;
+          BOOST_FOREACH(json_value const& v, a)
+          {
+              os << separator;
+              boost::apply_visitor(*this, v);
+              os << std::flush;
+              separator = ", ";
+          }
+          os << " ]";
+      }
+
+      void operator()(json_object const& o) const
+      {
+          char const* separator = " ";
+          os << "{";
+          BOOST_FOREACH(json_object::value_type const& m, o)
+          {
+              os << separator;
+              (*this)(m.first.str());
+              os << " : ";
+              boost::apply_visitor(*this, m.second);
+              separator = ", ";
+          }
+          os << " }";
+      }
+
+      std::ostream& os;
+  };
+}
+
+struct print_to_stream
+{
+    explicit print_to_stream(json_value const& v) : v(v) {}
+
+    void operator()() const
+    {
+        std::ofstream out("/dev/null");
+        boost::apply_visitor(ostream_printer::print(out), v);
+    }
+
+    json_value const& v;
+};
+
+struct write_to_fd
+{
+    write_to_fd(json_value const& v, json_writer::format f) : v(v), f(f) {}
+
+    void operator()() const
+    {
+        int const fd = ::open("/dev/null", O_WRONLY);
+        {
+            json_writer w(f, fd);
+            w.write(v);
+            w.flush();
+        }
+        ::close(fd);
+    }
+
+    json_value const& v;
+    json_writer::format f;
+};
+
+int main(int const argc, char const* argv[])
+{
+    file_source input(argc > 1 ? argv[1] : "test.json");
+    std::size_t const size = parse_size(argc > 2 ? argv[2] : "16M");
+    std::string const text = scale(input.begin(), input.end(), size);
+    token_iterator toks = tokens(text);
+    json_value const v = parse_json_value(toks);
+
+    report("ostream printer", time_it(print_to_stream(v)), text.size());
+    report("json_writer, compact", time_it(write_to_fd(v, json_writer::compact)), text.size());
+    report("json_writer, pretty", time_it(write_to_fd(v, json_writer::pretty)), text.size());
+}